@@ -218,7 +218,7 @@ public:
 
     u8* get_payload()
     {
-        return linear_buffer + user_payload_pos;
+        return get_payload(linear_buffer);
     }
 
     len_type get_payload_len()
@@ -227,9 +227,30 @@ public:
     }
 
     len_type get_packet_len()
+    {
+        return get_packet_len(linear_buffer);
+    }
+
+    void prepare_packet(len_type len)
+    {
+        prepare_packet(linear_buffer, len);
+    }
+
+    // the same, for a packet built in a buffer other than the linear buffer, such as a file write buffer.
+    // the buffer needs room for packet_len() of the payload length, and the alignment the verifier works with (none for noop_verifier)
+    u8* get_payload(u8* packet)
+    {
+        return packet + user_payload_pos;
+    }
+
+    len_type get_packet_len(u8* packet)
+    {
+        return packet_len(reinterpret<len_type>(packet + len_pos));
+    }
+
+    len_type packet_len(len_type len) // size of the packet carrying a payload of len bytes
     {
         len_type size = user_payload_pos;
-        len_type len = reinterpret<len_type>(linear_buffer + len_pos);
         size += len;
         if (use_verification)
         {
@@ -242,31 +263,31 @@ public:
         return size;
     }
 
-    void prepare_packet(len_type len)
+    void prepare_packet(u8* packet, len_type len)
     {
         if (use_start_marker)
-            linear_buffer[0] = start_marker_val;
-        reinterpret<len_type>(linear_buffer + len_pos, len);
+            packet[0] = start_marker_val;
+        reinterpret<len_type>(packet + len_pos, len);
         if (use_seq_id)
-            reinterpret<seq_id_type>(linear_buffer + payload_pos, sequence_id++);
+            reinterpret<seq_id_type>(packet + payload_pos, sequence_id++);
         u32 post_payload_pos = user_payload_pos + len;
         if (may_need_realignment)
         {
             u32 padding = payload_padding(len);
             for (u32 j = 0; j < padding; j++)
-                linear_buffer[post_payload_pos++] = 0;
+                packet[post_payload_pos++] = 0;
         }
         if (use_verification)
-            reinterpret<typename verifier_type::verifier_result_t>(linear_buffer + post_payload_pos, verifier.compute(linear_buffer + payload_pos, len + seq_id_size));
+            reinterpret<typename verifier_type::verifier_result_t>(packet + post_payload_pos, verifier.compute(packet + payload_pos, len + seq_id_size));
         if (use_stop_marker)
         {
             if (use_verification)
-                linear_buffer[post_payload_pos + sizeof(typename verifier_type::verifier_result_t)] = stop_marker_val;
+                packet[post_payload_pos + sizeof(typename verifier_type::verifier_result_t)] = stop_marker_val;
             else
-                linear_buffer[post_payload_pos] = stop_marker_val;
+                packet[post_payload_pos] = stop_marker_val;
         }
         
-        assert(get_packet_len() <= max_len);
+        assert(get_packet_len(packet) <= max_len);
     }
 
     void get_stats(u32& orphan, u32& missed, u32& aborts, u32& failed_ver)
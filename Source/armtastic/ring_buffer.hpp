@@ -201,11 +201,31 @@ public:
         return true;
     }
 
+    data_t* get_buffer()
+    {
+        return buf;
+    }
+
+    u32 get_size()
+    {
+        return size;
+    }
+
+    u32 write_until_wrap() // elements between the write position and the end of the buffer
+    {
+        return buf + size - write_pos;
+    }
+
     data_t* get_read_pointer()
     {
         return const_cast<data_t*>(read_pos);
     }
 
+    u32 read_until_wrap() // elements between the read position and the end of the buffer
+    {
+        return buf + size - read_pos;
+    }
+
     bool advance_read_pointer(u32 count)
     {
         if (count <= awaiting())
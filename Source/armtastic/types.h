@@ -5,8 +5,13 @@ typedef unsigned char      u8;
 typedef signed   char      s8;
 typedef unsigned short     u16;
 typedef signed   short     s16;
+#if defined(__LP64__) // host builds, where long is 64 bits
+typedef unsigned int       u32;
+typedef signed   int       s32;
+#else
 typedef unsigned long      u32;
 typedef signed   long      s32;
+#endif
 typedef unsigned long long u64;
 typedef signed   long long s64;
 
@@ -4,7 +4,11 @@
 
 #include "types.h" // Legacy types defined in pure C header
 
-typedef u32 size_t;
+#if defined(__LP64__) // host builds, size_t is 64 bits there
+    #include <stddef.h>
+#else
+    typedef u32 size_t;
+#endif
 
 template <typename Type> inline Type max_t(Type a, Type b)      {return (a > b) ? a : b;}
 template <typename Type> inline Type min_t(Type a, Type b)      {return (a < b) ? a : b;}
@@ -248,6 +248,8 @@ namespace sd
             idle = 0,
             started,
             transferring,
+            stopping,
+            stopping_from_error,
             error,
         };
     }
@@ -267,6 +269,8 @@ namespace sd
 
     static const u32 block_size = 512; // sector sizes for FAT are 512 bytes.
     static const u32 max_transfer_blocks = MAX_SD_WRITE_CONSECUTIVE_BLOCKS;
+    static const u32 max_read_blocks = MAX_SD_READ_CONSECUTIVE_BLOCKS;
+    BOOST_STATIC_ASSERT(max_read_blocks * block_size <= 0xFFFF); // the data length register is 16-bit wide
 
     #if SD_DEBUG // normally, this buffer is declared in the filesystem implementation
         #if ENABLE_SD_DMA && DDR_LOADER && !defined(NO_CACHE_ENABLE) && !FORCE_SD_DMA_BUFFER_STATIC_RAM
@@ -279,7 +283,7 @@ namespace sd
     class controller
     {
     public:
-        controller() : inserted(false), command_state(command_states::idle), receive_state(receive_states::idle), transmit_state(transmit_states::idle), unknown_transmit_status(false), current_data(0), command_done_mask(0), transfer_done_mask(0), error_mask(0), event(0) {}
+        controller() : inserted(false), command_state(command_states::idle), receive_state(receive_states::idle), transmit_state(transmit_states::idle), unknown_transmit_status(false), current_data(0), to_receive(0), async_pending(false), async_result(true), command_done_mask(0), transfer_done_mask(0), error_mask(0), event(0) {}
 
         void init(u8 cmd_int_priority, u8 data_int_priority, bool fast_irq)
         {
@@ -459,6 +463,41 @@ namespace sd
             #endif
         }
 
+        // reads consecutive blocks with a single 'read multiple' command, instead of paying for a command round trip on each block
+        bool read_blocks(u32 start_block, u8* buffer, u32 block_count)
+        {
+            if (block_count > max_read_blocks)
+                return false;
+            assert_fs_safe(block_count > 0);
+            if (block_count == 1)
+                return read_block(start_block, buffer);
+
+            #if ENABLE_SD_CONSISTENCY // the consistency check is done on single blocks
+                for (u32 b = 0; b < block_count; ++b)
+                {
+                    if (!read_block(start_block + b, buffer + b * block_size))
+                        return false;
+                }
+                return true;
+            #else
+                current_data = reinterpret_cast<u32*>(buffer);
+                to_receive = block_size * block_count;
+
+                while (regs.status.receive_data_available) // empty the read FIFO
+                {
+                    volatile u32 tmp = regs.fifo_begin;
+                    unused(tmp);
+                }
+
+                issue_command(commands::read_multiple, start_block * block_size);
+                #if ENABLE_CACHE_COHERENCE
+                    cp15_force_cache_coherence(reinterpret_cast<u32*>(buffer), reinterpret_cast<u32*>(buffer + block_size * block_count));
+                #endif
+
+                return !error();
+            #endif
+        }
+
         bool write_block(u32 start_block, u8* buffer, u32 block_count)
         {
             if (block_count > max_transfer_blocks)
@@ -532,6 +571,61 @@ namespace sd
             #endif
         }
 
+        // starts writing the blocks and returns while the card is being fed, by DMA or by the transmit interrupt. the buffer must be left
+        // untouched until complete_write returns. there is only one write in flight : submitting another one, or issuing any other command,
+        // first completes the previous one. as with write_block, the card may still be programming the data after the completion.
+        bool submit_write(u32 start_block, u8* buffer, u32 block_count)
+        {
+            if (block_count > max_transfer_blocks)
+                return false;
+            assert_fs_safe(block_count > 0);
+
+            #if ENABLE_SD_CONSISTENCY // the read back needs the bus, keep it synchronous
+                if (async_pending)
+                    complete_write();
+                async_result = write_block(start_block, buffer, block_count);
+                return true;
+            #else
+                if (async_pending)
+                    complete_write();
+
+                current_data = reinterpret_cast<u32*>(buffer);
+                to_send = block_size * block_count;
+
+                #if ENABLE_CACHE_COHERENCE
+                    cp15_force_cache_coherence(reinterpret_cast<u32*>(buffer), reinterpret_cast<u32*>(buffer + block_size * block_count));
+                #endif
+                if (block_count == 1)
+                    issue_command(commands::write_single, start_block * block_size, false);
+                else
+                    issue_command(commands::write_multiple, start_block * block_size, false);
+                return true;
+            #endif
+        }
+
+        // waits for the write started by submit_write, returns its success. returns the last result if nothing is in flight anymore.
+        bool complete_write()
+        {
+            if (!async_pending)
+                return async_result;
+            async_pending = false;
+
+            wait_for_command(async_command); // the timeout only starts now, which errs on the safe side
+
+            if (error())
+            {
+                last_transmit_error = transmit_error;
+                last_command_error = command_error;
+            }
+            async_result = !error();
+            return async_result;
+        }
+
+        bool write_pending()
+        {
+            return async_pending;
+        }
+
         bool error()
         {
             return transmit_states::error == transmit_state || receive_states::error == receive_state || command_states::error == command_state;
@@ -764,8 +858,8 @@ namespace sd
             regs.clear.command_timeout = true;
             regs.clear.command_crc_failed = true;
 
-            if (commands::write_multiple != current_command || error)
-                get_int_ctrl().disable_interrupt(interrupt::id::sd_0); // in write_multiple, a 'stop transmission' command will follow shortly
+            if ((commands::write_multiple != current_command && commands::read_multiple != current_command) || error)
+                get_int_ctrl().disable_interrupt(interrupt::id::sd_0); // in write_multiple and read_multiple, a 'stop transmission' command will follow shortly
 
             if (commands::stop_xfer == current_command)
             {
@@ -773,6 +867,10 @@ namespace sd
                     transmit_state = transmit_states::idle;
                 else
                     transmit_state = transmit_states::error;
+                if (receive_states::stopping == receive_state)
+                    receive_state = receive_states::idle;
+                else if (receive_states::stopping_from_error == receive_state)
+                    receive_state = receive_states::error;
                 if (event)
                     ctl_events_set_clear(event, transfer_done_mask, 0);
             }
@@ -860,7 +958,8 @@ namespace sd
             {
                 while (regs.status.receive_data_available) // No more data expected, so read what's left in the FIFO
                     *current_data++ = regs.fifo_begin;
-                done = true;
+                if (commands::read_single == current_command) // in read_multiple, the data counter tells when the last block is in
+                    done = true;
             }
             else if (regs.status.receive_fifo_half_full) // The FIFO is at least half full, so read out 8 words of data
             {
@@ -898,11 +997,20 @@ namespace sd
                 regs.int_mask_1.write(0);
                 regs.data_control.enable = false;
 
-                receive_state = (done) ? receive_states::idle : receive_states::error;
-                if (event)
+                if (commands::read_multiple == current_command)
                 {
-                    if (done) ctl_events_set_clear(event, transfer_done_mask, 0);
-                    else ctl_events_set_clear(event, error_mask, 0);
+                    if (done) receive_state = receive_states::stopping;
+                    else      receive_state = receive_states::stopping_from_error;
+                    simple_issue_command(commands::stop_xfer);
+                }
+                else
+                {
+                    receive_state = (done) ? receive_states::idle : receive_states::error;
+                    if (event)
+                    {
+                        if (done) ctl_events_set_clear(event, transfer_done_mask, 0);
+                        else ctl_events_set_clear(event, error_mask, 0);
+                    }
                 }
             }
             else
@@ -1012,11 +1120,20 @@ namespace sd
                 regs.data_control.enable = false;
                 get_dma().disable<0>();
 
-                receive_state = (done) ? receive_states::idle : receive_states::error;
-                if (event)
+                if (commands::read_multiple == current_command)
                 {
-                    if (done) ctl_events_set_clear(event, transfer_done_mask, 0);
-                    else ctl_events_set_clear(event, error_mask, 0);
+                    if (done) receive_state = receive_states::stopping;
+                    else      receive_state = receive_states::stopping_from_error;
+                    simple_issue_command(commands::stop_xfer);
+                }
+                else
+                {
+                    receive_state = (done) ? receive_states::idle : receive_states::error;
+                    if (event)
+                    {
+                        if (done) ctl_events_set_clear(event, transfer_done_mask, 0);
+                        else ctl_events_set_clear(event, error_mask, 0);
+                    }
                 }
             }
             else
@@ -1109,8 +1226,11 @@ namespace sd
         // if this returns false, the device is already busy, and you need to retry
         // this method is getting large. that's because most of the command specific handling is done. it may be broken down
         // between read, write and normal commands.
-        void issue_command(commands::en cmd, u32 arg = 0)
+        // wait : when false, a write command returns as soon as it is started, see submit_write.
+        void issue_command(commands::en cmd, u32 arg = 0, bool wait = true)
         {
+            if (async_pending) // the hardware handles a single transfer at a time
+                complete_write();
             resolve_transmit_status();
             command_state = command_states::idle;
             receive_state = receive_states::idle;
@@ -1155,7 +1275,7 @@ namespace sd
                 command_state = command_states::pending_write;
                 unknown_transmit_status = true;
             }
-            else if (commands::read_single == cmd)
+            else if (commands::read_single == cmd || commands::read_multiple == cmd)
             {
                 regs.int_mask_1.write(0);
                 #if ENABLE_SD_DMA
@@ -1179,8 +1299,16 @@ namespace sd
                 regs.int_mask_1.data_timeout = true;
                 regs.int_mask_1.data_crc_failed = true;
 
-                regs.data_timer = worst_case_timeout;
-                regs.data_len = block_size;
+                if (commands::read_single == cmd)
+                {
+                    regs.data_timer = worst_case_timeout;
+                    regs.data_len = block_size;
+                }
+                else
+                {
+                    regs.data_timer = worst_case_timeout * (to_receive / block_size);
+                    regs.data_len = to_receive;
+                }
                 regs.data_control.direction_receive = 1;
                 receive_state = receive_states::started;
                 command_state = command_states::pending_read;
@@ -1201,12 +1329,27 @@ namespace sd
 
             regs.command.enable = true; // triggers the command state machine
 
-            if (commands::read_single == cmd)
+            if (commands::read_single == cmd || commands::read_multiple == cmd)
                 regs.data_control.enable = true; // start data state machine as well
 
+            if (!wait && (commands::write_single == cmd || commands::write_multiple == cmd))
+            {
+                async_pending = true;
+                async_command = cmd;
+                return;
+            }
+
+            wait_for_command(cmd);
+        }
+
+        // waits for the end of the command, including its data transfer, and records timeouts as errors of the proper state machine
+        void wait_for_command(commands::en cmd)
+        {
             u32 timeout_ms = 100;
             if (commands::write_multiple == cmd)
                 timeout_ms *= (to_send / block_size);
+            else if (commands::read_multiple == cmd)
+                timeout_ms *= (to_receive / block_size);
             bool timeout = false;
             if (!event)
             {
@@ -1220,7 +1363,7 @@ namespace sd
                     {
                         if (commands::write_single == cmd || commands::write_multiple == cmd)
                             done = (transmit_states::error == transmit_state || transmit_states::idle == transmit_state);
-                        else if (commands::read_single == cmd)
+                        else if (commands::read_single == cmd || commands::read_multiple == cmd)
                             done = (receive_states::error == receive_state || receive_states::idle == receive_state);
                         else
                             done = true;
@@ -1243,7 +1386,7 @@ namespace sd
             else
             {
                 u32 mask = error_mask;
-                if (commands::write_single == cmd || commands::write_multiple == cmd || commands::read_single == cmd)
+                if (commands::write_single == cmd || commands::write_multiple == cmd || commands::read_single == cmd || commands::read_multiple == cmd)
                     mask |= transfer_done_mask;
                 else
                     mask |= command_done_mask;
@@ -1261,7 +1404,7 @@ namespace sd
                     transmit_state = transmit_states::error;
                     transmit_error = errors::event_timeout;
                 }
-                else if (commands::read_single == cmd)
+                else if (commands::read_single == cmd || commands::read_multiple == cmd)
                 {
                     receive_state = receive_states::error;
                     receive_error = errors::event_timeout;
@@ -1410,6 +1553,11 @@ namespace sd
 
         u32* current_data;
         u32 to_send;
+        u32 to_receive;
+
+        bool async_pending;
+        bool async_result;
+        commands::en async_command;
 
         CTL_EVENT_SET_t command_done_mask, transfer_done_mask, error_mask;
         CTL_EVENT_SET_t* event;
@@ -1474,6 +1622,7 @@ namespace sd
                     switch (cmd)
                     {
                     case commands::read_single:
+                    case commands::read_multiple:
                         op_stats = &debug_stats.read;
                         error = &receive_error;
                         break;
@@ -1519,6 +1668,9 @@ namespace sd
                     case commands::read_single:
                         ++debug_stats.total_read_blocks;
                         break;
+                    case commands::read_multiple:
+                        debug_stats.total_read_blocks += to_receive / block_size;
+                        break;
                     case commands::write_single:
                     case commands::write_multiple:
                         ++debug_stats.total_written_blocks;
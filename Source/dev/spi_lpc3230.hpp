@@ -6,7 +6,6 @@
 #include "interrupt_lpc3230.hpp"
 #include "clock_lpc3230.hpp"
 #include "assert.h"
-#include "modules/async/delayed_result.hpp"
 
 namespace lpc3230
 {
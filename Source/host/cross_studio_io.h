@@ -0,0 +1,10 @@
+#pragma once
+
+// Host stand-in for the CrossWorks debug I/O, see readme.txt. Output goes to the console, a break aborts.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define debug_enabled() 1
+#define debug_break() abort()
+#define debug_printf printf
@@ -0,0 +1,91 @@
+#pragma once
+
+// Host stand-in for the CrossWorks Tasking Library (CTL), see readme.txt. Only the calls used by the file system
+// and messaging modules are provided. Tasks are pthreads, scheduled by the host : priorities are recorded, but not enforced.
+// All the kernel objects are protected by a single lock, the way the CTL protects them by disabling interrupts, and the
+// tasks waiting on one sleep on a futex over it.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned CTL_EVENT_SET_t;
+typedef unsigned CTL_SEMAPHORE_t;
+typedef unsigned long CTL_TIME_t;
+
+typedef struct CTL_TASK_s
+{
+    const char* name;
+    unsigned char priority;
+    unsigned char state;
+    void (*entrypoint)(void*);
+    void* parameter;
+    unsigned long thread; // the pthread_t, <pthread.h> is kept out of the project includes
+} CTL_TASK_t;
+
+typedef struct CTL_MUTEX_s
+{
+    CTL_TASK_t* lock_owner;
+    unsigned lock_count;
+} CTL_MUTEX_t;
+
+typedef enum
+{
+    CTL_TIMEOUT_NONE,
+    CTL_TIMEOUT_INFINITE = CTL_TIMEOUT_NONE,
+    CTL_TIMEOUT_ABSOLUTE,
+    CTL_TIMEOUT_DELAY,
+    CTL_TIMEOUT_NOW,
+} CTL_TIMEOUT_t;
+
+typedef enum
+{
+    CTL_EVENT_WAIT_ANY_EVENTS,
+    CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR,
+    CTL_EVENT_WAIT_ALL_EVENTS,
+    CTL_EVENT_WAIT_ALL_EVENTS_WITH_AUTO_CLEAR,
+} CTL_EVENT_WAIT_TYPE_t;
+
+#define CTL_STATE_RUNNABLE  0x00
+#define CTL_STATE_SUSPENDED 0x80
+
+// tasks
+void ctl_task_init(CTL_TASK_t* task, unsigned char priority, const char* name);
+void ctl_task_run(CTL_TASK_t* task, unsigned char priority, void (*entrypoint)(void*), void* parameter, const char* name, unsigned stack_size_in_words, unsigned* stack, unsigned call_size_in_words);
+void ctl_task_remove(CTL_TASK_t* task);
+unsigned char ctl_task_set_priority(CTL_TASK_t* task, unsigned char priority);
+void ctl_task_reschedule(void);
+CTL_TASK_t* ctl_host_task_executing(void);
+#define ctl_task_executing (ctl_host_task_executing())
+
+// time, in milliseconds ticks
+CTL_TIME_t ctl_get_current_time(void);
+#define ctl_current_time (ctl_get_current_time())
+unsigned long ctl_get_ticks_per_second(void);
+void ctl_timeout_wait(CTL_TIME_t timeout);
+
+// interrupts : the host has none, a task is never in interrupt context
+unsigned ctl_host_interrupt_count(void);
+#define ctl_interrupt_count (ctl_host_interrupt_count())
+
+// disabling interrupts takes a process wide recursive lock, so an 'interrupt' section excludes the other tasks
+int ctl_global_interrupts_set(int enable);
+
+// events
+void ctl_events_init(CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t set);
+void ctl_events_set_clear(CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t set_events, CTL_EVENT_SET_t clear_events);
+CTL_EVENT_SET_t ctl_events_wait(CTL_EVENT_WAIT_TYPE_t type, CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t events, CTL_TIMEOUT_t t, CTL_TIME_t timeout);
+
+// mutexes, recursive as in the CTL
+void ctl_mutex_init(CTL_MUTEX_t* m);
+unsigned ctl_mutex_lock(CTL_MUTEX_t* m, CTL_TIMEOUT_t t, CTL_TIME_t timeout);
+void ctl_mutex_unlock(CTL_MUTEX_t* m);
+
+// semaphores
+void ctl_semaphore_init(CTL_SEMAPHORE_t* s, unsigned value);
+void ctl_semaphore_signal(CTL_SEMAPHORE_t* s);
+unsigned ctl_semaphore_wait(CTL_SEMAPHORE_t* s, CTL_TIMEOUT_t t, CTL_TIME_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
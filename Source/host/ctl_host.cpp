@@ -0,0 +1,316 @@
+#include "ctl_api.h"
+#include "host_time.h"
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// the kernel lock : every CTL object is read and modified under it. a task waiting on an object sleeps on a futex over the object's
+// own word (the event set, the semaphore count, the mutex lock count), with the value it saw under the lock : a change made between
+// its release of the lock and its sleep makes the futex return at once, so no wake up is lost. a change only wakes the tasks waiting
+// on that object, which then re-evaluate their own condition, and costs no system call while no task waits on it.
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t interrupt_lock;
+static const unsigned waiter_buckets = 64;
+static unsigned waiting[waiter_buckets]; // tasks asleep or about to be, by hash of the word they wait on, under the kernel lock
+
+static __thread CTL_TASK_t* current_task = 0;
+static __thread CTL_TASK_t unnamed_task; // for the threads not created through ctl_task_run
+static __thread int interrupts_disabled = 0;
+
+static struct timespec start_time;
+
+static void kernel_init()
+{
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&interrupt_lock, &mutex_attr);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+static void kernel_enter()
+{
+    pthread_once(&kernel_once, kernel_init);
+    pthread_mutex_lock(&kernel_lock);
+}
+
+static unsigned& waiters(unsigned* word)
+{
+    return waiting[(reinterpret_cast<unsigned long>(word) / sizeof(unsigned)) % waiter_buckets];
+}
+
+// changed is the word of the object modified, if any : up to wake_count of the tasks waiting on it are woken up
+static void kernel_leave(unsigned* changed, int wake_count = INT_MAX)
+{
+    bool wake = changed && waiters(changed);
+    pthread_mutex_unlock(&kernel_lock);
+    if (wake)
+        syscall(SYS_futex, changed, FUTEX_WAKE_PRIVATE, wake_count, 0, 0, 0);
+}
+
+static CTL_TIME_t deadline(CTL_TIMEOUT_t t, CTL_TIME_t timeout)
+{
+    switch (t)
+    {
+    case CTL_TIMEOUT_ABSOLUTE: return timeout;
+    case CTL_TIMEOUT_DELAY:    return ctl_get_current_time() + timeout;
+    case CTL_TIMEOUT_NOW:      return ctl_get_current_time();
+    default:                   return 0; // never
+    }
+}
+
+// with the kernel lock held, until word changes. false once the deadline is passed, without waiting : the callers check their
+// condition again after every wake up, so a change racing with the deadline is not missed
+static bool kernel_wait(unsigned* word, CTL_TIMEOUT_t t, CTL_TIME_t until)
+{
+    struct timespec remaining;
+    if (CTL_TIMEOUT_NONE != t)
+    {
+        CTL_TIME_t now = ctl_get_current_time();
+        if (now >= until)
+            return false;
+        remaining.tv_sec = (until - now) / 1000;
+        remaining.tv_nsec = ((until - now) % 1000) * 1000000;
+    }
+
+    unsigned seen = *word;
+    ++waiters(word);
+    pthread_mutex_unlock(&kernel_lock);
+        syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, (CTL_TIMEOUT_NONE == t) ? 0 : &remaining, 0, 0);
+    pthread_mutex_lock(&kernel_lock);
+    --waiters(word);
+    return true;
+}
+
+CTL_TASK_t* ctl_host_task_executing(void)
+{
+    if (!current_task)
+    {
+        unnamed_task.name = "host";
+        unnamed_task.thread = pthread_self();
+        current_task = &unnamed_task;
+    }
+    return current_task;
+}
+
+void ctl_task_init(CTL_TASK_t* task, unsigned char priority, const char* name)
+{
+    task->name = name;
+    task->priority = priority;
+    task->state = CTL_STATE_RUNNABLE;
+    task->thread = pthread_self();
+    current_task = task;
+}
+
+static void* task_entry(void* argument)
+{
+    CTL_TASK_t* task = static_cast<CTL_TASK_t*>(argument);
+    current_task = task;
+    task->entrypoint(task->parameter);
+
+    kernel_enter();
+        task->state = CTL_STATE_SUSPENDED; // what task_join() polls for
+    kernel_leave(0);
+    return 0;
+}
+
+void ctl_task_run(CTL_TASK_t* task, unsigned char priority, void (*entrypoint)(void*), void* parameter, const char* name, unsigned stack_size_in_words, unsigned* stack, unsigned call_size_in_words)
+{
+    // the stack given is left unused, the host thread gets its own
+    task->name = name;
+    task->priority = priority;
+    task->state = CTL_STATE_RUNNABLE;
+    task->entrypoint = entrypoint;
+    task->parameter = parameter;
+    pthread_t thread;
+    pthread_create(&thread, 0, task_entry, task);
+    pthread_detach(thread);
+    task->thread = thread;
+}
+
+void ctl_task_remove(CTL_TASK_t* task)
+{
+    // a host thread cannot be killed safely. the tasks removed on the target are the ones already done (see task_join)
+    task->state = CTL_STATE_SUSPENDED;
+}
+
+unsigned char ctl_task_set_priority(CTL_TASK_t* task, unsigned char priority)
+{
+    unsigned char previous = task->priority;
+    task->priority = priority;
+    return previous;
+}
+
+void ctl_task_reschedule(void)
+{
+    sched_yield();
+}
+
+CTL_TIME_t ctl_get_current_time(void)
+{
+    pthread_once(&kernel_once, kernel_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000;
+}
+
+unsigned ctl_host_interrupt_count(void)
+{
+    return 0;
+}
+
+unsigned long ctl_get_ticks_per_second(void)
+{
+    return 1000;
+}
+
+void ctl_timeout_wait(CTL_TIME_t timeout)
+{
+    CTL_TIME_t now = ctl_get_current_time();
+    struct timespec ts;
+    if (timeout > now)
+    {
+        ts.tv_sec = (timeout - now) / 1000;
+        ts.tv_nsec = ((timeout - now) % 1000) * 1000000;
+    }
+    else // the CTL reschedules at the next tick at the earliest
+    {
+        ts.tv_sec = 0;
+        ts.tv_nsec = 1000000;
+    }
+    nanosleep(&ts, 0);
+}
+
+int ctl_global_interrupts_set(int enable)
+{
+    pthread_once(&kernel_once, kernel_init);
+    int was_enabled = !interrupts_disabled;
+    if (!enable && was_enabled)
+    {
+        pthread_mutex_lock(&interrupt_lock);
+        interrupts_disabled = 1;
+    }
+    else if (enable && !was_enabled)
+    {
+        interrupts_disabled = 0;
+        pthread_mutex_unlock(&interrupt_lock);
+    }
+    return was_enabled;
+}
+
+void ctl_events_init(CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t set)
+{
+    kernel_enter();
+        *event_set = set;
+    kernel_leave(event_set);
+}
+
+void ctl_events_set_clear(CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t set_events, CTL_EVENT_SET_t clear_events)
+{
+    kernel_enter();
+        *event_set = (*event_set | set_events) & ~clear_events;
+    kernel_leave(event_set);
+}
+
+CTL_EVENT_SET_t ctl_events_wait(CTL_EVENT_WAIT_TYPE_t type, CTL_EVENT_SET_t* event_set, CTL_EVENT_SET_t events, CTL_TIMEOUT_t t, CTL_TIME_t timeout)
+{
+    bool all = (CTL_EVENT_WAIT_ALL_EVENTS == type || CTL_EVENT_WAIT_ALL_EVENTS_WITH_AUTO_CLEAR == type);
+    bool auto_clear = (CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR == type || CTL_EVENT_WAIT_ALL_EVENTS_WITH_AUTO_CLEAR == type);
+    CTL_TIME_t until = deadline(t, timeout);
+    CTL_EVENT_SET_t result = 0;
+
+    kernel_enter();
+        while (true)
+        {
+            CTL_EVENT_SET_t current = *event_set & events;
+            if (all ? (current == events) : (current != 0))
+            {
+                result = current;
+                break;
+            }
+            if (!kernel_wait(event_set, t, until))
+                break;
+        }
+        if (result && auto_clear)
+            *event_set &= ~result;
+    kernel_leave((result && auto_clear) ? event_set : 0);
+    return result;
+}
+
+void ctl_mutex_init(CTL_MUTEX_t* m)
+{
+    m->lock_owner = 0;
+    m->lock_count = 0;
+}
+
+unsigned ctl_mutex_lock(CTL_MUTEX_t* m, CTL_TIMEOUT_t t, CTL_TIME_t timeout)
+{
+    CTL_TASK_t* self = ctl_host_task_executing();
+    CTL_TIME_t until = deadline(t, timeout);
+    unsigned locked = 0;
+
+    kernel_enter();
+        while (true)
+        {
+            if (0 == m->lock_owner || self == m->lock_owner)
+            {
+                m->lock_owner = self;
+                ++m->lock_count;
+                locked = 1;
+                break;
+            }
+            if (!kernel_wait(&m->lock_count, t, until))
+                break;
+        }
+    kernel_leave(0);
+    return locked;
+}
+
+void ctl_mutex_unlock(CTL_MUTEX_t* m)
+{
+    kernel_enter();
+        if (m->lock_count && 0 == --m->lock_count)
+            m->lock_owner = 0;
+    kernel_leave((0 == m->lock_count) ? &m->lock_count : 0, 1); // a single task can take it
+}
+
+void ctl_semaphore_init(CTL_SEMAPHORE_t* s, unsigned value)
+{
+    kernel_enter();
+        *s = value;
+    kernel_leave(s);
+}
+
+void ctl_semaphore_signal(CTL_SEMAPHORE_t* s)
+{
+    kernel_enter();
+        ++*s;
+    kernel_leave(s, 1); // a single task can take it
+}
+
+unsigned ctl_semaphore_wait(CTL_SEMAPHORE_t* s, CTL_TIMEOUT_t t, CTL_TIME_t timeout)
+{
+    CTL_TIME_t until = deadline(t, timeout);
+    unsigned taken = 0;
+
+    kernel_enter();
+        while (true)
+        {
+            if (*s)
+            {
+                --*s;
+                taken = 1;
+                break;
+            }
+            if (!kernel_wait(s, t, until))
+                break;
+        }
+    kernel_leave(0);
+    return taken;
+}
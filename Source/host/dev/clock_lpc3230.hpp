@@ -0,0 +1,64 @@
+#pragma once
+
+// Host stand-in for the LPC3230 clock controller, see readme.txt. The system time runs on the monotonic clock, in nanoseconds.
+
+#include "armtastic/types.hpp"
+#include "modules/init/globals.hpp"
+#include "host_time.h"
+
+typedef u64 us;
+
+namespace lpc3230
+{
+
+namespace clock
+{
+    class controller
+    {
+    public:
+        u64 get_system_time()
+        {
+            return host_monotonic_ns();
+        }
+
+        u64 get_system_freq()
+        {
+            return 1000000000ull;
+        }
+
+        us system_to_microsec(u64& sys_time)
+        {
+            return sys_time / 1000;
+        }
+
+        u32 system_to_millisec(u64& sys_time)
+        {
+            return system_to_microsec(sys_time) / 1000;
+        }
+
+        float system_to_sec(u64& sys_time)
+        {
+            return (float)system_to_microsec(sys_time) / 1000000.0f;
+        }
+
+        us get_microsec_time()
+        {
+            u64 sys_time = get_system_time();
+            return system_to_microsec(sys_time);
+        }
+
+        u32 get_millisec_time()
+        {
+            u64 sys_time = get_system_time();
+            return system_to_millisec(sys_time);
+        }
+
+        u32 get_sec_time()
+        {
+            u64 sys_time = get_system_time();
+            return system_to_millisec(sys_time) / 1000;
+        }
+    };
+}
+
+}
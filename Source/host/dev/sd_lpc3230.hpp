@@ -0,0 +1,161 @@
+#pragma once
+
+// Host stand-in for the LPC3230 SD controller, see readme.txt. The card is a FAT image file mapped in memory, so the file
+// system code above it, the sector caches included, runs unchanged. Each command can be made to take the time a real card
+// would, as a fixed command latency plus a per sector transfer time, plus a programming time for the written sectors.
+
+#include "armtastic/types.hpp"
+#include "modules/init/globals.hpp"
+#include "boost/static_assert.hpp"
+#include "host_time.h"
+#include <ctl_api.h>
+#include <string.h>
+
+#if ENABLE_SD_STATS
+    #include "modules/debug/debug_io.hpp"
+#endif
+
+namespace lpc3230
+{
+
+namespace sd
+{
+    static const u32 block_size = 512; // sector sizes for FAT are 512 bytes.
+    static const u32 max_transfer_blocks = MAX_SD_WRITE_CONSECUTIVE_BLOCKS;
+    static const u32 max_read_blocks = MAX_SD_READ_CONSECUTIVE_BLOCKS;
+
+    class controller
+    {
+    public:
+        controller() : image(0), image_blocks(0), image_fd(-1), command_ns(0), sector_ns(0), write_busy_ns(0),
+                       async_pending(false), async_result(true), async_start(0), async_buffer(0), async_count(0), async_done_time(0), last_error(false) {}
+
+        ~controller()
+        {
+            detach();
+        }
+
+        bool attach(const char* image_path); // maps the image file as the card, see host_sd.cpp
+        void detach(); // completes the pending write, and syncs the image back to its file
+
+        // the time taken by each command : a fixed part, plus a part for each sector transferred, plus a part for each sector programmed
+        void set_latency(u32 command_us, u32 sector_us, u32 write_busy_us = 0)
+        {
+            command_ns = (u64)command_us * 1000;
+            sector_ns = (u64)sector_us * 1000;
+            write_busy_ns = (u64)write_busy_us * 1000;
+        }
+
+        void init(u8 cmd_int_priority, u8 data_int_priority, bool fast_irq)
+        {
+        }
+
+        bool card_inserted()
+        {
+            return 0 != image;
+        }
+
+        bool read_block(u32 block, u8* buffer)
+        {
+            return read_blocks(block, buffer, 1);
+        }
+
+        bool read_blocks(u32 start_block, u8* buffer, u32 block_count)
+        {
+            if (async_pending)
+                complete_write();
+            wait_until(now() + command_ns + block_count * sector_ns);
+            last_error = !in_range(start_block, block_count);
+            if (last_error)
+                return false;
+            memcpy(buffer, image + (size_t)start_block * block_size, (size_t)block_count * block_size);
+            return true;
+        }
+
+        bool write_block(u32 start_block, u8* buffer, u32 block_count)
+        {
+            if (!submit_write(start_block, buffer, block_count))
+                return false;
+            return complete_write();
+        }
+
+        // starts a write and returns right away. the buffer must stay untouched until complete_write() returns.
+        bool submit_write(u32 start_block, u8* buffer, u32 block_count)
+        {
+            if (async_pending)
+                complete_write();
+            if (!in_range(start_block, block_count))
+            {
+                last_error = true;
+                return false;
+            }
+            async_start = start_block;
+            async_buffer = buffer;
+            async_count = block_count;
+            async_done_time = now() + command_ns + block_count * (sector_ns + write_busy_ns);
+            async_pending = true;
+            return true;
+        }
+
+        bool complete_write()
+        {
+            if (!async_pending)
+                return async_result;
+            wait_until(async_done_time);
+            memcpy(image + (size_t)async_start * block_size, async_buffer, (size_t)async_count * block_size);
+            async_pending = false;
+            async_result = true;
+            last_error = false;
+            return async_result;
+        }
+
+        bool write_pending()
+        {
+            return async_pending;
+        }
+
+        bool error()
+        {
+            return last_error;
+        }
+
+        void set_done_event(CTL_EVENT_SET_t* external_event, CTL_EVENT_SET_t command_done_flag, CTL_EVENT_SET_t transfer_done_flag, CTL_EVENT_SET_t error_flag)
+        {
+        }
+
+    private:
+        bool in_range(u32 start_block, u32 block_count)
+        {
+            return image && block_count && start_block < image_blocks && block_count <= image_blocks - start_block;
+        }
+
+        static u64 now()
+        {
+            return host_monotonic_ns();
+        }
+
+        static void wait_until(u64 time_ns)
+        {
+            host_sleep_until_ns(time_ns);
+        }
+
+        u8* image;
+        u32 image_blocks;
+        int image_fd;
+
+        u64 command_ns;
+        u64 sector_ns;
+        u64 write_busy_ns;
+
+        bool async_pending;
+        bool async_result;
+        u32 async_start;
+        u8* async_buffer;
+        u32 async_count;
+        u64 async_done_time;
+
+        bool last_error;
+    };
+}
+
+}
@@ -0,0 +1,77 @@
+#include "modules/init/globals.hpp"
+#include "modules/file_system/file_system.hpp"
+#include "modules/file_system/file_system_queue.hpp"
+#include "dev/clock_lpc3230.hpp"
+#include "dev/sd_lpc3230.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Writes through the file system and its write queue onto a FAT image, for each queue depth, the way benchmarks::sd::write_depths
+// does on the card. usage : fs_benchmark image [command_us sector_us write_busy_us [megabytes]]
+
+static u32 bulk_buffer[MAX_SD_READ_CONSECUTIVE_BLOCKS * SECTOR_SIZE / 4];
+
+static float queued_write(u32 queued_len) // in bytes per second, until the last block has reached the image
+{
+    fs::FILE queued_file;
+    bool opened = fs::fopen(&queued_file, "bench/queued.dat", 'w', true);
+    assert(opened);
+
+    u64 begin = get_hw_clock().get_system_time();
+    for (u32 b = 0; b < queued_len / sizeof(bulk_buffer); ++b)
+        fs::fwrite(bulk_buffer, sizeof(bulk_buffer), 1, &queued_file);
+    fs::fclose(&queued_file);
+    while (!get_fs_queue().is_idle())
+        ctl_timeout_wait(ctl_get_current_time() + 1);
+    u64 delay = get_hw_clock().get_system_time() - begin;
+    us elapsed = get_hw_clock().system_to_microsec(delay);
+
+    return static_cast<float>(queued_len) / (static_cast<float>(elapsed) / 1000000.f);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 5 && argc != 6)
+    {
+        ::printf("usage : %s image [command_us sector_us write_busy_us [megabytes]]\n", argv[0]);
+        return 1;
+    }
+
+    static CTL_TASK_t main_task;
+    ctl_task_init(&main_task, 255, "main");
+
+    if (DFS_OK != DFS_HostAttach(argv[1]))
+    {
+        ::printf("cannot map %s\n", argv[1]);
+        return 1;
+    }
+    if (argc >= 5)
+        get_sd().set_latency(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+    u32 megabytes = (argc == 6) ? atoi(argv[5]) : 1;
+
+    get_central().init();
+    get_fs_queue().init();
+    fs::init();
+
+    static CTL_TASK_t fs_queue_task;
+    ctl_task_run(&fs_queue_task, thread_priorities::fs_queue, fs::queue::static_thread, 0, "fs_queue", 0, 0, 0);
+
+    for (u32 i = 0; i < sizeof(bulk_buffer) / sizeof(u32); i++)
+        bulk_buffer[i] = i;
+
+    static const u32 depths[] = {1, 2, 4};
+    for (u32 d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d)
+    {
+        get_fs_queue().set_write_depth(depths[d]);
+        float rate = queued_write(megabytes * 1024 * 1024);
+        ::printf("write_depth_%u : %.3f MB/s\n", (unsigned)depths[d], rate / (1024.f * 1024.f));
+    }
+
+    get_central().send_message(msg::src::fs_queue, msg::id::request_to_end_task);
+    while (CTL_STATE_SUSPENDED != fs_queue_task.state)
+        ctl_timeout_wait(ctl_get_current_time() + 1);
+
+    fs::end();
+    get_sd().detach();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "modules/init/globals.hpp"
+#include "modules/file_system/file_system.hpp"
+#include "modules/file_system/file_system_queue.hpp"
+#include "dev/sd_lpc3230.hpp"
+#include <stdio.h>
+
+// Writes files through the write queue past several queued blocks, flushes and closes them, then reads them back once the queue has
+// ended : every byte written must be in the file, and fflush must succeed while the queue runs. usage : fs_queue_test image
+
+static const u32 file_count = 3;
+static const u32 file_len = 3 * fs::queue_write_buffer_size + 100; // a few full blocks, then a partial one left to fflush
+
+static u8 pattern(u32 file, u32 pos)
+{
+    return static_cast<u8>(pos * 7 + file * 31 + (pos >> 9));
+}
+
+static void wait_idle()
+{
+    while (!get_fs_queue().is_idle())
+        ctl_timeout_wait(ctl_get_current_time() + 1);
+}
+
+static bool write_file(u32 n, const char* name)
+{
+    fs::FILE f;
+    if (!fs::fopen(&f, name, 'w', true, 1))
+    {
+        ::printf("%s : cannot open\n", name);
+        return false;
+    }
+    u8 chunk[300];
+    for (u32 pos = 0; pos < file_len; pos += sizeof(chunk))
+    {
+        u32 len = (file_len - pos < sizeof(chunk)) ? file_len - pos : sizeof(chunk);
+        for (u32 i = 0; i < len; ++i)
+            chunk[i] = pattern(n, pos + i);
+        fs::fwrite(chunk, len, 1, &f);
+    }
+    bool flushed = 0 != fs::fflush(&f);
+    wait_idle();
+    fs::fclose(&f);
+    wait_idle();
+    if (!flushed)
+        ::printf("%s : fflush failed\n", name);
+    return flushed;
+}
+
+static bool check_file(u32 n, const char* name)
+{
+    fs::FILE f;
+    if (!fs::fopen(&f, name, 'r', true))
+    {
+        ::printf("%s : cannot open for reading\n", name);
+        return false;
+    }
+    u32 read_len = 0;
+    u32 mismatches = 0;
+    u8 chunk[512];
+    size_t got;
+    while ((got = fs::fread(chunk, 1, sizeof(chunk), &f)) > 0)
+    {
+        for (u32 i = 0; i < got; ++i)
+            if (read_len + i >= file_len || chunk[i] != pattern(n, read_len + i))
+                ++mismatches;
+        read_len += got;
+    }
+    fs::fclose(&f);
+    ::printf("%s : %u of %u bytes, %u wrong\n", name, read_len, file_len, mismatches);
+    return read_len == file_len && !mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        ::printf("usage : %s image\n", argv[0]);
+        return 1;
+    }
+
+    static CTL_TASK_t main_task;
+    ctl_task_init(&main_task, 255, "main");
+
+    if (DFS_OK != DFS_HostAttach(argv[1]))
+    {
+        ::printf("cannot map %s\n", argv[1]);
+        return 1;
+    }
+
+    get_central().init();
+    get_fs_queue().init();
+    fs::init();
+
+    static CTL_TASK_t fs_queue_task;
+    ctl_task_run(&fs_queue_task, thread_priorities::fs_queue, fs::queue::static_thread, 0, "fs_queue", 0, 0, 0);
+
+    static const char* names[file_count] = { "fsqtest/a.dat", "fsqtest/b.dat", "fsqtest/c.dat" };
+    bool ok = true;
+    for (u32 n = 0; n < file_count; ++n) // the later files once the queue has already written blocks
+        ok &= write_file(n, names[n]);
+
+    get_central().send_message(msg::src::fs_queue, msg::id::request_to_end_task);
+    while (CTL_STATE_SUSPENDED != fs_queue_task.state)
+        ctl_timeout_wait(ctl_get_current_time() + 1);
+    for (u32 n = 0; n < file_count; ++n)
+        ok &= check_file(n, names[n]);
+    fs::end();
+
+    get_sd().detach();
+    ::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
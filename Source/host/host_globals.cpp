@@ -0,0 +1,90 @@
+#include "modules/init/globals.hpp"
+#include "modules/file_system/file_system.hpp"
+#include "modules/file_system/file_system_queue.hpp"
+#include "modules/clock/rt_clock.hpp"
+#include "modules/debug/debug_io.hpp"
+#include "dev/clock_lpc3230.hpp"
+#include "dev/sd_lpc3230.hpp"
+#include <stdarg.h>
+#include <stdio.h>
+
+// The globals of the file system build, see modules/init/globals.cpp for the target ones
+
+lpc3230::sd::controller sd;
+lpc3230::sd::controller& get_sd() { return sd; }
+
+lpc3230::clock::controller hw_clock;
+lpc3230::clock::controller& get_hw_clock() { return hw_clock; }
+
+clock::rt_clock rt_clock;
+clock::rt_clock& get_rt_clock() { return rt_clock; }
+
+#if ENABLE_FS_QUEUE
+    fs::queue fs_queue;
+    fs::queue& get_fs_queue() { return fs_queue; }
+#endif
+
+msg::central central;
+msg::central& get_central() { return central; }
+
+uint32_t DFS_HostAttach(const char* imgfile)
+{
+    return get_sd().attach(imgfile) ? DFS_OK : DFS_ERRMISC;
+}
+
+namespace debug {
+
+static const char* const log_prefixes[] = {"trace : ", "", "warning : ", "error : ", "trace : ", "", "warning : ", "error : "};
+
+int printf(const char* fmt, ... )
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = vprintf(fmt, args);
+    va_end(args);
+    return written;
+}
+
+int printf_ln(const char* fmt, ... )
+{
+    va_list args;
+    va_start(args, fmt);
+    int written = vprintf(fmt, args);
+    va_end(args);
+    return written + ::printf("\n");
+}
+
+void log(log_types type, const char* fmt, ... )
+{
+    va_list args;
+    va_start(args, fmt);
+    ::printf("%s", log_prefixes[type]);
+    vprintf(fmt, args);
+    ::printf("\n");
+    va_end(args);
+}
+
+}
+
+extern "C"
+{
+void log_error(const char* fmt, ... )
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "error : ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+void log_error_no_fs(const char* fmt, ... )
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "error : ");
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+}
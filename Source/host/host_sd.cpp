@@ -0,0 +1,52 @@
+#include "dev/sd_lpc3230.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace lpc3230 {
+namespace sd {
+
+bool controller::attach(const char* image_path)
+{
+    detach();
+    image_fd = open(image_path, O_RDWR);
+    if (image_fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(image_fd, &info) || info.st_size < (off_t)block_size)
+    {
+        detach();
+        return false;
+    }
+    void* mapped = mmap(0, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, image_fd, 0);
+    if (MAP_FAILED == mapped)
+    {
+        detach();
+        return false;
+    }
+    image = static_cast<u8*>(mapped);
+    image_blocks = info.st_size / block_size;
+    return true;
+}
+
+void controller::detach()
+{
+    if (image)
+    {
+        if (async_pending)
+            complete_write();
+        msync(image, (size_t)image_blocks * block_size, MS_SYNC);
+        munmap(image, (size_t)image_blocks * block_size);
+        image = 0;
+        image_blocks = 0;
+    }
+    if (image_fd >= 0)
+    {
+        close(image_fd);
+        image_fd = -1;
+    }
+}
+
+}
+}
@@ -0,0 +1,32 @@
+#include "host_time.h"
+#include <time.h>
+
+unsigned long long host_monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void host_sleep_until_ns(unsigned long long time_ns)
+{
+    struct timespec until;
+    until.tv_sec = time_ns / 1000000000ull;
+    until.tv_nsec = time_ns % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0)) {} // restarted when interrupted by a signal
+}
+
+int host_local_time(int* year, int* month, int* day, int* hour, int* minute, int* second)
+{
+    time_t now = time(0);
+    struct tm local;
+    if (!localtime_r(&now, &local))
+        return 0;
+    *year = local.tm_year + 1900;
+    *month = local.tm_mon + 1;
+    *day = local.tm_mday;
+    *hour = local.tm_hour;
+    *minute = local.tm_min;
+    *second = local.tm_sec;
+    return 1;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Host time services. Kept apart from <time.h>, whose clock() collides with the clock namespace of the project.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long long host_monotonic_ns(void);
+void host_sleep_until_ns(unsigned long long time_ns);
+int host_local_time(int* year, int* month, int* day, int* hour, int* minute, int* second); // 0 on failure
+
+#ifdef __cplusplus
+}
+#endif
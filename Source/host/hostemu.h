@@ -0,0 +1,21 @@
+#pragma once
+
+// The DOSFS host emulation hook, pulled by dosfs.hpp when HOSTVER is defined. Unlike the original DOSFS hostemu, the
+// sectors are not read here : DFS_ReadSector and DFS_WriteSector stay in file_system.cpp, over the host SD controller.
+
+// maps the FAT image file as the card. returns 0 on success, DFS_ERRMISC if the file cannot be opened or mapped.
+uint32_t DFS_HostAttach(const char* imgfile);
+
+#ifdef __cplusplus
+    #include <stdlib.h>
+    // dosfs divides its unsigned offsets with div(). the host C++ library overloads div() for long and long long as well, which makes
+    // these calls ambiguous : these exact matches keep the int division the target does.
+    inline div_t div(uint32_t numer, uint32_t denom)
+    {
+        return div(static_cast<int>(numer), static_cast<int>(denom));
+    }
+    inline div_t div(int numer, uint32_t denom)
+    {
+        return div(numer, static_cast<int>(denom));
+    }
+#endif
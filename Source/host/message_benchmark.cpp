@@ -0,0 +1,282 @@
+#include "modules/init/globals.hpp"
+#include "modules/sinks/sinks.hpp"
+#include "modules/async/multi_blocking_queues.hpp"
+#include "dev/clock_lpc3230.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Measures the message bus on the host : messages per second and end to end latencies from sending tasks to a sink, the same through
+// a multi writer blocking queue, and the cost of a global message against its number of listeners. usage : message_benchmark [messages]
+
+static const u32 max_messages = 4000000;
+static const u32 max_senders = 4;
+
+struct stamped // the benchmark payload
+{
+    u64 sent_time; // system time before the send
+    u32 sender;
+    u32 sequence;
+};
+
+static u32 latencies[max_messages]; // nanoseconds, in reception order
+static u32 received;
+static u32 out_of_order;
+static u32 next_sequence[max_senders];
+static u64 last_reception;
+
+static void reset_reception()
+{
+    received = out_of_order = 0;
+    for (u32 s = 0; s < max_senders; ++s)
+        next_sequence[s] = 0;
+}
+
+static void receive(const stamped& m)
+{
+    last_reception = get_hw_clock().get_system_time();
+    if (received < max_messages)
+        latencies[received] = static_cast<u32>(last_reception - m.sent_time);
+    ++received;
+    if (m.sequence != next_sequence[m.sender])
+        ++out_of_order;
+    next_sequence[m.sender] = m.sequence + 1;
+}
+
+// throughput from the first send to the last reception, then the latency percentiles
+static void report(const char* name, u32 senders, u32 sent, u64 begin)
+{
+    u64 elapsed = last_reception - begin;
+    float seconds = static_cast<float>(elapsed) / static_cast<float>(get_hw_clock().get_system_freq());
+    ::printf("%-16s %u sender(s) : %u/%u received, %u out of order, %.0f messages/s\n", name, senders, received, sent, out_of_order, received / seconds);
+
+    u32 n = std::min(received, max_messages);
+    if (!n)
+        return;
+    std::sort(latencies, latencies + n);
+    ::printf("%-16s latency us : p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", "",
+             latencies[n / 2] / 1000.f, latencies[n * 9 / 10] / 1000.f, latencies[n * 99 / 100] / 1000.f, latencies[n * 999 / 1000] / 1000.f, latencies[n - 1] / 1000.f);
+}
+
+static void join(CTL_TASK_t& task)
+{
+    while (CTL_STATE_SUSPENDED != task.state)
+        ctl_timeout_wait(ctl_get_current_time() + 1);
+    ctl_task_remove(&task);
+}
+
+struct sender_context
+{
+    u32 sender;
+    u32 count;
+};
+
+static sender_context senders[max_senders];
+static CTL_TASK_t sender_tasks[max_senders];
+static CTL_TASK_t receiver_task;
+
+// through msg::central, from the sending tasks to a sink observing its queue, the way the modules exchange their messages
+namespace stream
+{
+    class sink : public base_sink<sink, msg::src::fs_queue>
+    {
+    public:
+        void run()
+        {
+            ctl_events_init(&event, 0);
+            get_central().set_event(msg::src::fs_queue, &event, 1);
+            bool done = false;
+            while (!done)
+            {
+                CTL_EVENT_SET_t e = ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &event, 1, CTL_TIMEOUT_DELAY, 10);
+                done = observe_all_messages(e);
+            }
+        }
+
+        static void static_thread(void* argument)
+        {
+            static_cast<sink*>(argument)->run();
+        }
+
+    private:
+        void stamped_event(u32 len)
+        {
+            receive(current_payload<stamped>(len));
+        }
+
+        CTL_EVENT_SET_t event;
+
+    public:
+        typedef on<msg::id::auxctl_info, &sink::stamped_event> observers;
+    };
+
+    static void sender(void* argument)
+    {
+        sender_context& c = *static_cast<sender_context*>(argument);
+        stamped m;
+        m.sender = c.sender;
+        for (u32 i = 0; i < c.count; ++i)
+        {
+            m.sequence = i;
+            m.sent_time = get_hw_clock().get_system_time();
+            get_central().send_message(msg::src::fs_queue, msg::id::auxctl_info, sizeof(m), reinterpret_cast<u8*>(&m));
+        }
+    }
+
+    static void run(u32 sender_count, u32 messages)
+    {
+        static sink s;
+        get_central().init();
+        reset_reception();
+        ctl_task_run(&receiver_task, thread_priorities::fs_queue, sink::static_thread, &s, "bench_sink", 0, 0, 0);
+
+        u64 begin = get_hw_clock().get_system_time();
+        for (u32 t = 0; t < sender_count; ++t)
+        {
+            senders[t].sender = t;
+            senders[t].count = messages / sender_count;
+            ctl_task_run(&sender_tasks[t], thread_priorities::main, sender, &senders[t], "bench_sender", 0, 0, 0);
+        }
+        for (u32 t = 0; t < sender_count; ++t)
+            join(sender_tasks[t]);
+        get_central().send_message(msg::src::fs_queue, msg::id::request_to_end_task);
+        join(receiver_task);
+
+        report("central", sender_count, messages / sender_count * sender_count, begin);
+      #if ENABLE_MESSAGE_STATS
+        const async::message_queue::statistics* stats = get_central().get_queue_stats(msg::src::fs_queue);
+        ::printf("%-16s queue : %u/%u bytes high water, %u drops\n", "", stats->task_high_water, stats->task_size, stats->task_drops);
+      #endif
+    }
+}
+
+// through an async::multi_writer_blocking_queue, the way the file system queues its writes
+namespace blocking
+{
+    static const u32 depth = 64;
+    static async::multi_writer_blocking_queue<stamped, depth> queue;
+    static CTL_EVENT_SET_t event;
+    static u32 expected;
+
+    static void receiver(void* argument)
+    {
+        while (received < expected)
+        {
+            ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &event, 1, CTL_TIMEOUT_DELAY, 10);
+            stamped m;
+            while (queue.read(m))
+                receive(m);
+        }
+    }
+
+    static void sender(void* argument)
+    {
+        sender_context& c = *static_cast<sender_context*>(argument);
+        stamped m;
+        m.sender = c.sender;
+        for (u32 i = 0; i < c.count; ++i)
+        {
+            m.sequence = i;
+            m.sent_time = get_hw_clock().get_system_time();
+            queue.write(m);
+        }
+    }
+
+    static void run(u32 sender_count, u32 messages)
+    {
+        queue.init();
+        ctl_events_init(&event, 0);
+        queue.set_event(&event, 1);
+        reset_reception();
+        expected = messages / sender_count * sender_count;
+        ctl_task_run(&receiver_task, thread_priorities::fs_queue, receiver, 0, "bench_receiver", 0, 0, 0);
+
+        u64 begin = get_hw_clock().get_system_time();
+        for (u32 t = 0; t < sender_count; ++t)
+        {
+            senders[t].sender = t;
+            senders[t].count = messages / sender_count;
+            ctl_task_run(&sender_tasks[t], thread_priorities::main, sender, &senders[t], "bench_sender", 0, 0, 0);
+        }
+        for (u32 t = 0; t < sender_count; ++t)
+            join(sender_tasks[t]);
+        join(receiver_task);
+
+        report("blocking queue", sender_count, expected, begin);
+    }
+}
+
+// the cost of send_global_message as listeners are added, for a payload copied in each queue and for one long enough to be shared. from a
+// single task, each queue being drained between the sends, so only the send itself is timed
+namespace fan_out
+{
+    // the largest queues first, a record of the longer payload does not always fit the 64 bytes ones
+    static const msg::src::en listeners[] = { msg::src::gps_processor, msg::src::fs_queue, msg::src::time_queue, msg::src::main, msg::src::aux };
+    static const u32 listener_count = sizeof(listeners) / sizeof(msg::src::en);
+
+    static void run(u32 payload_len, u32 sends)
+    {
+        u8 payload[32];
+        assert(payload_len <= sizeof(payload));
+        memset(payload, 0x5a, sizeof(payload));
+
+        for (u32 l = 1; l <= listener_count; ++l)
+        {
+            msg::central& central = get_central();
+            central.init();
+            for (u32 i = 0; i < l; ++i)
+                central.subscribe_to_global_message(listeners[i], msg::id::battery_level);
+
+            u64 sending = 0;
+            u32 delivered = 0;
+            for (u32 s = 0; s < sends; ++s)
+            {
+                u64 begin = get_hw_clock().get_system_time();
+                central.send_global_message(msg::id::battery_level, payload_len, payload);
+                sending += get_hw_clock().get_system_time() - begin;
+
+                for (u32 i = 0; i < l; ++i)
+                {
+                    msg::id::en id = msg::id::none;
+                    u32 len = 0;
+                    while (central.get_message(listeners[i], id, len))
+                    {
+                        central.message_done(listeners[i], len);
+                        ++delivered;
+                    }
+                }
+            }
+
+            // as send_global_message decides, whether the message stats are compiled in or not
+            bool shared = l > 1 && payload_len > sizeof(const u8*) && payload_len <= msg::shared_payload_slot_size;
+            ::printf("fan out %2u bytes, %u listener(s) : %.0f ns per send, %.0f ns per delivery, %u/%u delivered%s\n", payload_len, l,
+                     static_cast<float>(sending) / sends, static_cast<float>(sending) / std::max(delivered, 1u), delivered, sends * l, shared ? ", shared" : "");
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2)
+    {
+        ::printf("usage : %s [messages]\n", argv[0]);
+        return 1;
+    }
+    u32 messages = (argc == 2) ? atoi(argv[1]) : 200000;
+    if (!messages || messages > max_messages)
+    {
+        ::printf("between 1 and %u messages\n", max_messages);
+        return 1;
+    }
+
+    static CTL_TASK_t main_task;
+    ctl_task_init(&main_task, 255, "main");
+
+    for (u32 senders = 1; senders <= 3; senders += 2)
+        stream::run(senders, messages);
+    for (u32 senders = 1; senders <= 3; senders += 2)
+        blocking::run(senders, messages);
+    fan_out::run(4, messages / 10);
+    fan_out::run(32, messages / 10);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// Host stand-in for the real time clock, see readme.txt. The date and time come from the host, instead of the GPS.
+
+#include "modules/init/project.hpp"
+#include "modules/init/globals.hpp"
+#include "dev/clock_lpc3230.hpp"
+#include "host_time.h"
+
+struct timedate
+{
+    int year;
+    int month;
+    int day;
+    int hour;
+    int min;
+    double sec;
+};
+
+namespace clock {
+
+class rt_clock
+{
+public:
+    bool get_real_time(timedate& time)
+    {
+        int year, month, day, hour, minute, second;
+        if (!host_local_time(&year, &month, &day, &hour, &minute, &second))
+            return false;
+        time.year = year;
+        time.month = month;
+        time.day = day;
+        time.hour = hour;
+        time.min = minute;
+        time.sec = second;
+        return true;
+    }
+
+    bool get_timepulse_millisec(u32& ms)
+    {
+        return false; // no GPS
+    }
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Host stand-in for the debug I/O, see readme.txt. Everything is printed on the console.
+
+#include "armtastic/types.hpp"
+#include "modules/init/globals.hpp"
+
+namespace debug {
+
+int printf(const char* fmt, ... );
+int printf_ln(const char* fmt, ... );
+
+enum log_types
+{
+    tracing,
+    message,
+    warning,
+    error,
+    tracing_no_fs,
+    message_no_fs,
+    warning_no_fs,
+    error_no_fs,
+};
+
+void log(log_types type, const char* fmt, ... );
+
+}
+
+extern "C"
+{
+void log_error(const char* fmt, ... );
+void log_error_no_fs(const char* fmt, ... );
+}
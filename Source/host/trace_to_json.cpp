@@ -0,0 +1,197 @@
+#include "modules/profiling/event_trace.hpp"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Converts the profiler event trace written by the 'ptrace' console command (profile.trc) to the chrome trace event format, to be opened
+// with chrome://tracing or ui.perfetto.dev. usage : trace_to_json profile.trc [profile.json]
+// The samples of each task are nested slices on the task's own line, the interrupts are slices on a line of their own, and a cpu line shows
+// which task was running between the task switches.
+
+using namespace profile::trace;
+
+static const u32 tasks_pid = 1;
+static const u32 cpu_pid = 2;
+static const u32 running_tid = 0; // in cpu_pid
+static const u32 interrupts_tid = 1;
+
+static std::vector<std::string> names(0x10000);
+static FILE* out;
+static bool first_event = true;
+
+static std::string quoted(const std::string& s)
+{
+    std::string q = "\"";
+    for (u32 i = 0; i < s.size(); ++i)
+    {
+        if ('"' == s[i] || '\\' == s[i])
+            q += '\\';
+        if (static_cast<unsigned char>(s[i]) >= 0x20)
+            q += s[i];
+    }
+    return q + "\"";
+}
+
+static std::string name_of(u32 sample)
+{
+    if (names[sample].empty())
+    {
+        char unnamed[16];
+        snprintf(unnamed, sizeof(unnamed), "sample %u", sample);
+        return unnamed;
+    }
+    return names[sample];
+}
+
+static void event(const char* fields)
+{
+    fprintf(out, "%s\n{%s}", first_event ? "" : ",", fields);
+    first_event = false;
+}
+
+static void metadata(const char* what, u32 pid, u32 tid, const std::string& name)
+{
+    char fields[256];
+    snprintf(fields, sizeof(fields), "\"name\":\"%s\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":%s}", what, pid, tid, quoted(name).c_str());
+    event(fields);
+}
+
+static void slice(const char* phase, u32 pid, u32 tid, const std::string& name, double ts)
+{
+    char fields[256];
+    snprintf(fields, sizeof(fields), "\"name\":%s,\"ph\":\"%s\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f", quoted(name).c_str(), phase, pid, tid, ts);
+    event(fields);
+}
+
+static void complete(u32 pid, u32 tid, const std::string& name, double ts, double duration)
+{
+    char fields[256];
+    snprintf(fields, sizeof(fields), "\"name\":%s,\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", quoted(name).c_str(), pid, tid, ts, duration);
+    event(fields);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        printf("usage : %s profile.trc [profile.json]\n", argv[0]);
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    file_header header;
+    if (1 != fread(&header, sizeof(header), 1, in) || file_magic != header.magic || file_version != header.version || !header.system_freq)
+    {
+        printf("%s is not a profiler trace of version %u\n", argv[1], file_version);
+        return 1;
+    }
+    for (u32 n = 0; n < header.name_count; ++n)
+    {
+        name_entry entry;
+        if (1 != fread(&entry, sizeof(entry), 1, in))
+        {
+            printf("%s is truncated\n", argv[1]);
+            return 1;
+        }
+        entry.name[sizeof(entry.name) - 1] = 0;
+        names[entry.sample] = entry.name;
+    }
+    std::vector<record> records(header.record_count);
+    if (header.record_count && header.record_count != fread(&records[0], sizeof(record), header.record_count, in))
+    {
+        printf("%s is truncated\n", argv[1]);
+        return 1;
+    }
+    fclose(in);
+
+    out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+    if (!out)
+    {
+        printf("cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    // the full times, back from the newest record, in microseconds from the oldest
+    std::vector<double> ts(records.size());
+    if (!records.empty())
+    {
+        std::vector<u64> times(records.size());
+        times.back() = header.last_time;
+        for (size_t i = records.size() - 1; i > 0; --i)
+            times[i - 1] = times[i] - static_cast<u32>(records[i].time - records[i - 1].time);
+        for (size_t i = 0; i < records.size(); ++i)
+            ts[i] = static_cast<double>(times[i] - times[0]) * 1e6 / header.system_freq;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"records\":%u,\"lost\":%u},\"traceEvents\":[", header.record_count, header.lost);
+    metadata("process_name", tasks_pid, 0, "tasks");
+    metadata("process_name", cpu_pid, 0, "cpu");
+    metadata("thread_name", cpu_pid, running_tid, "running");
+    metadata("thread_name", cpu_pid, interrupts_tid, "interrupts");
+    for (u32 task = 0; task < header.task_count; ++task)
+        if (!names[task * header.samples_per_tasks].empty())
+            metadata("thread_name", tasks_pid, task, names[task * header.samples_per_tasks]);
+
+    // the trace starts anywhere : the ends of what began before it are skipped, the tasks and interrupts stay properly nested
+    std::vector<u32> depth(header.task_count + 1); // the last one for the interrupts
+    u32 running = header.task_count; // unknown until the first task switch
+    double running_since = 0;
+    u32 kept = 0;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const record& r = records[i];
+        u32 task = r.task;
+        if (task >= header.task_count)
+            continue;
+        switch (r.type)
+        {
+        case record_type::begin:
+            slice("B", tasks_pid, task, name_of(r.sample), ts[i]);
+            ++depth[task];
+            break;
+        case record_type::end:
+            if (!depth[task])
+                continue;
+            slice("E", tasks_pid, task, name_of(r.sample), ts[i]);
+            --depth[task];
+            break;
+        case record_type::interrupt_begin:
+            slice("B", cpu_pid, interrupts_tid, name_of(r.sample), ts[i]);
+            ++depth[header.task_count];
+            break;
+        case record_type::interrupt_end:
+            if (!depth[header.task_count])
+                continue;
+            slice("E", cpu_pid, interrupts_tid, name_of(r.sample), ts[i]);
+            --depth[header.task_count];
+            break;
+        case record_type::task_switch:
+            {
+                u32 from = (header.task_count == running) ? r.sample : running;
+                if (from < header.task_count)
+                    complete(cpu_pid, running_tid, name_of(from * header.samples_per_tasks), running_since, ts[i] - running_since);
+                running = task;
+                running_since = ts[i];
+            }
+            break;
+        default:
+            continue;
+        }
+        ++kept;
+    }
+    if (running < header.task_count && !ts.empty())
+        complete(cpu_pid, running_tid, name_of(running * header.samples_per_tasks), running_since, ts.back() - running_since);
+    fprintf(out, "\n]}\n");
+
+    if (out != stdout)
+    {
+        fclose(out);
+        printf("%u of %u records converted, %u lost before the dump, %.3f ms traced\n", kept, header.record_count, header.lost, ts.empty() ? 0. : ts.back() / 1000.);
+    }
+    return 0;
+}
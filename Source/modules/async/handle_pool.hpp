@@ -0,0 +1,84 @@
+#pragma once
+
+#include "armtastic/types.hpp"
+#include "assert.h"
+#include "boost/static_assert.hpp"
+#include <ctl_api.h>
+
+namespace async
+{
+    // numbered slots handed out to any task, and given back by whoever ends their use. a handle is its slot with the slot's generation, counted
+    // at each allocation : a handle kept after its slot was given back no longer matches, so acting on it is safely ignored. 0 is never a handle.
+    // allocations and releases are short sections with interrupts disabled.
+    template <u32 slot_count>
+    class handle_pool
+    {
+    public:
+        static const u32 slot_bits = 16;
+        BOOST_STATIC_ASSERT(slot_count && slot_count <= (1 << slot_bits));
+
+        void init()
+        {
+            for (u32 i = 0; i < slot_count; ++i)
+            {
+                free_slots[i] = static_cast<u16>(slot_count - 1 - i); // the lowest slots first
+                generations[i] = 0;
+                used[i] = false;
+            }
+            free_count = slot_count;
+            high_water = exhausted = 0;
+        }
+
+        // 0 if all the slots are in use
+        u32 allocate()
+        {
+            u32 handle = 0;
+            int enabled = ctl_global_interrupts_set(0);
+                if (free_count)
+                {
+                    u32 slot = free_slots[--free_count];
+                    if (0 == ++generations[slot]) // so the handle is never 0
+                        generations[slot] = 1;
+                    used[slot] = true;
+                    handle = (generations[slot] << slot_bits) | slot;
+                    if (slot_count - free_count > high_water)
+                        high_water = slot_count - free_count;
+                }
+                else
+                    ++exhausted;
+            ctl_global_interrupts_set(enabled);
+            return handle;
+        }
+
+        // false once the handle was released
+        bool valid(u32 handle)
+        {
+            u32 s = slot(handle);
+            return s < slot_count && used[s] && generations[s] == (handle >> slot_bits);
+        }
+
+        static u32 slot(u32 handle) { return handle & ((1 << slot_bits) - 1); }
+
+        void release(u32 handle)
+        {
+            int enabled = ctl_global_interrupts_set(0);
+                assert(valid(handle));
+                u32 s = slot(handle);
+                used[s] = false;
+                free_slots[free_count++] = static_cast<u16>(s);
+            ctl_global_interrupts_set(enabled);
+        }
+
+        u32 get_in_use() { return slot_count - free_count; }
+        u32 get_high_water() { return high_water; }
+        u32 get_exhausted() { return exhausted; } // allocations refused
+
+    private:
+        u16 free_slots[slot_count]; // a stack, the first free_count ones
+        u16 generations[slot_count]; // of the latest allocation of each slot
+        bool used[slot_count];
+        u32 free_count;
+        u32 high_water;
+        u32 exhausted;
+    };
+}
@@ -1,29 +1,131 @@
 #pragma once
 
+#include "modules/init/project.hpp"
 #include "armtastic/ring_buffer.hpp"
+#include "modules/async/payload_slab.hpp"
 #include "boost/static_assert.hpp"
+#include "modules/init/globals.hpp"
+#include "dev/clock_lpc3230.hpp"
 #include <ctl_api.h>
 
 namespace async
 {
-    class message_queue
+  #if ENABLE_MESSAGE_STATS
+    // time spent in a queue, from the commit to the reader getting the message. bucket b counts the latencies below 2^b microseconds,
+    // the last one everything longer
+    struct latency_histogram
+    {
+        static const u32 bucket_count = 16;
+        u32 buckets[bucket_count];
+        u32 count;
+        u32 max_us;
+        u64 total_us;
+
+        void add(u32 latency_us)
+        {
+            u32 b = 0;
+            while (b < bucket_count - 1 && (latency_us >> b))
+                ++b;
+            ++buckets[b];
+            ++count;
+            total_us += latency_us;
+            if (latency_us > max_us)
+                max_us = latency_us;
+        }
+    };
+  #endif
+
+    // what a queue does with a message it has no room for
+    namespace overflow
+    {
+        enum en
+        {
+            drop_newest, // the message sent is lost
+            drop_oldest, // the oldest messages are removed to make room. unless the reader is in the middle of one, then as drop_newest
+            coalesce,    // for the ids of set_coalescing only, a message of the same id and length still awaiting is overwritten, it takes the
+                         // place of the older one. the other ids, which may not be merged, as drop_newest
+            block,       // the sender waits for room, up to a timeout. from interrupts, as drop_newest
+        };
+    }
+
+    namespace overflow_outcome
+    {
+        enum en
+        {
+            none,
+            dropped,   // the message sent is lost
+            evicted,   // older messages were lost to make room
+            coalesced, // an older message was overwritten
+            timed_out, // the sender waited in vain, the message sent is lost
+        };
+    }
+
+    struct overflow_report
+    {
+        overflow_outcome::en outcome;
+        u32 lost; // messages
+    };
+
+    // the payload of the messages sent by notify : an event which only needs handling once, however many times it happened meanwhile
+    struct notification
+    {
+        u32 count;       // events since the previous notification was taken
+        u64 latest_time; // system time of the latest one
+    };
+
+    // messages sent from tasks go to one ring, messages sent from interrupts to another, so an interrupt never waits on a task.
+    // with lock_free false, task senders take turns through a mutex from the reserve of their message to its commit. with lock_free true, they only
+    // claim their space with interrupts disabled (the ARM926 has no exclusive load/store), then fill the message in parallel and publish it
+    // by clearing its unpublished flag : a sender preempted midway never blocks the others, the reader simply stops at its message until it is published.
+    // the claim itself always runs with interrupts disabled, the overflow policies may move the read pointer or reuse a message.
+    // every message is contiguous in its ring, a skip record pads the end of the ring when the next one would not fit before the wrap. senders
+    // can thus build their payload in place (reserve, then commit) and receivers can look at it in place (current_payload).
+    // a message may also hold a reference to a payload shared with other queues (send_shared), released once the reader is done with it.
+    template <bool lock_free>
+    class basic_message_queue
     {
     public:
+        static const u32 alignment = 8; // the payloads may be viewed as structs holding doubles, which the ARM926 loads with LDRD
+
+      #if ENABLE_MESSAGE_STATS
+        struct statistics
+        {
+            u32 task_size, int_size;             // bytes, usable
+            u32 task_high_water, int_high_water; // bytes, the most ever awaiting the reader, padding included
+            u32 task_drops, int_drops;           // messages lost to a full queue, sent or evicted
+            u32 coalesced;                       // messages overwritten by a newer one, or notifications merged
+            latency_histogram latency;
+        };
+        const statistics& get_stats() { return stats; }
+        u32 current_latency() { return current_latency_us; } // of the message returned by the last get_message
+      #endif
+
         void init(u8* buffer, u32 task_size, u32 int_size)
         {
             assert(buffer);
-            assert((reinterpret_cast<u32>(buffer) & 0x3) == 0);
+            assert((reinterpret_cast<size_t>(buffer) & (alignment - 1)) == 0);
             assert(task_size);
-            assert((task_size & 0x3) == 0);
+            assert((task_size & (alignment - 1)) == 0);
             assert(int_size);
-            assert((int_size & 0x3) == 0);
+            assert((int_size & (alignment - 1)) == 0);
             queue_event = 0;
             message_mask = 0;
             mutex_queue.init(buffer, task_size);
             int_queue.init(buffer + task_size, int_size);
             at_payload = false;
             current_payload_in_task_queue = true;
+            current_len = 0;
+            current_shared = 0;
+            shared_payloads = 0;
+            coalesced_ids = 0;
             ctl_mutex_init(&write_mutex);
+            set_overflow_policy(overflow::drop_newest);
+          #if ENABLE_MESSAGE_STATS
+            memset(&stats, 0, sizeof(stats));
+            stats.task_size = task_size - 1;
+            stats.int_size = int_size - 1;
+            current_latency_us = 0;
+          #endif
         }
 
         void set_event(CTL_EVENT_SET_t* event, CTL_EVENT_SET_t message_flag)
@@ -34,129 +136,435 @@ namespace async
             message_mask = message_flag;
         }
 
-        void send_message(u32 id, u32 len, u8* payload)
+        // block_timeout in CTL ticks, only used by the block policy
+        void set_overflow_policy(overflow::en overflow_policy, CTL_TIME_t block_timeout = 0)
         {
-            assert((len == 0 && payload == 0) || (len && payload));
+            policy = overflow_policy;
+            blocking_timeout = block_timeout;
+            ctl_events_init(&room_event, 0);
+        }
 
-            u32 total_len = sizeof(header) + len;
-            header h;
-            h.id = id;
-            h.len = len;
+        // the notifications of these ids (bit id set) are merged into the one still awaiting the reader, if any. see notify.
+        // with overflow::coalesce, their other messages overwrite an awaiting one as well : only idempotent ids belong here
+        void set_coalescing(u32 id_mask)
+        {
+            coalesced_ids = id_mask;
+        }
 
-            u32 total_packing = (sizeof(u32) - (len & 0x3)) & 0x3;
-            total_len += total_packing;
+        // where the shared payloads come from, for send_shared
+        void set_payload_slab(payload_slab* slab)
+        {
+            shared_payloads = slab;
+        }
 
-            bool ok = false;
+        // returns where to build a payload of len bytes, aligned on 8 bytes, or 0 if the queue is full. every successful reserve must be
+        // followed by a commit from the same context, as soon as possible : the reader stops at the message until then.
+        // report, if given, tells what the overflow policy had to do, if anything.
+        u8* reserve(u32 id, u32 len, overflow_report* report = 0)
+        {
+            assert(!(len & (unpublished | shared)));
+            return reserve_record(id, len, len, report);
+        }
 
-            if (ctl_interrupt_count) // are we sending from interrupt context?
+        // queues a reference to a payload of the slab set, holding a reference for this queue. on failure, the reference is released
+        bool send_shared(u32 id, u32 len, const u8* payload, overflow_report* report = 0)
+        {
+            assert(shared_payloads);
+            assert(!(len & (unpublished | shared)));
+            u8* p = reserve_record(id, len | shared, sizeof(payload), report);
+            if (!p)
             {
-                if (int_queue.free() >= total_len)
-                {
-                    ok = int_queue.write_buffer(reinterpret_cast<u8*>(&h), sizeof(header));
-                    assert(ok);
-                    ok = int_queue.write_buffer(payload, len);
-                    assert(ok);
-                    int_queue.advance_write_pointer(total_packing); // we stay aligned
-                }
+                shared_payloads->release(payload);
+                return false;
             }
-            else
+            memcpy(p, &payload, sizeof(payload));
+            commit(p);
+            return true;
+        }
+
+        void commit(u8* payload)
+        {
+            assert(payload);
+            volatile header* h = reinterpret_cast<volatile header*>(payload - sizeof(header));
+          #if ENABLE_MESSAGE_STATS
+            h->sent_time = get_hw_clock().get_system_time();
+          #endif
+            __asm__ __volatile__ ("" ::: "memory"); // the whole payload is in place before the reader may see the message
+            h->len &= ~unpublished;
+
+            if (!lock_free && !ctl_interrupt_count)
+                ctl_mutex_unlock(&write_mutex);
+
+            if (queue_event)
+                ctl_events_set_clear(queue_event, message_mask, 0);
+        }
+
+        void send_message(u32 id, u32 len, u8* payload)
+        {
+            assert((len == 0 && payload == 0) || (len && payload));
+
+            u8* p = reserve(id, len);
+            if (!p)
+                return;
+            if (len)
+                memcpy(p, payload, len);
+            commit(p);
+        }
+
+        // sends a notification of id. if the id coalesces and a notification of it sent from the same context (task or interrupt) still
+        // awaits the reader, that one is updated instead : a burst of interrupts costs a single message and a single handling
+        void notify(u32 id, overflow_report* report = 0)
+        {
+            u64 now = get_hw_clock().get_system_time();
+            if (coalesces(id))
             {
-                // sending from non-interrupts, must protect ourselves against task switches
-                ctl_mutex_lock(&write_mutex, CTL_TIMEOUT_INFINITE, 0);
-    
-                if (mutex_queue.free() >= total_len)
+                bool merged = false;
+                int enabled = ctl_global_interrupts_set(0); // as a claim, the reader is excluded as well, see reader_excluded
+                    volatile u8* pending = find_published(ctl_interrupt_count ? int_queue : mutex_queue, id, sizeof(notification));
+                    if (pending)
+                    {
+                        volatile notification* n = reinterpret_cast<volatile notification*>(pending + sizeof(header));
+                        ++n->count;
+                        n->latest_time = now;
+                        merged = true;
+                      #if ENABLE_MESSAGE_STATS
+                        ++stats.coalesced;
+                      #endif
+                    }
+                ctl_global_interrupts_set(enabled);
+                if (merged)
                 {
-                    ok = mutex_queue.write_buffer(reinterpret_cast<u8*>(&h), sizeof(header));
-                    assert(ok);
-                    ok = mutex_queue.write_buffer(payload, len);
-                    assert(ok);
-                    mutex_queue.advance_write_pointer(total_packing); // we stay aligned
+                    if (report)
+                    {
+                        report->outcome = overflow_outcome::none;
+                        report->lost = 0;
+                    }
+                    return;
                 }
-    
-                ctl_mutex_unlock(&write_mutex);
             }
 
-            if (ok && queue_event)
-                ctl_events_set_clear(queue_event, message_mask, 0);
+            notification* n = reinterpret_cast<notification*>(reserve(id, sizeof(notification), report));
+            if (!n)
+                return;
+            n->count = 1;
+            n->latest_time = now;
+            commit(reinterpret_cast<u8*>(n));
         }
 
         bool get_message(u32& id, u32& len)
         {
-            current_payload_in_task_queue = get_task_message(id, len);
-            if (current_payload_in_task_queue)
-                at_payload = true;
-            else if(get_int_message(id, len))
-                at_payload = true;
+            int enabled = reader_excluded() ? ctl_global_interrupts_set(0) : 0; // see reserve_record
+                current_payload_in_task_queue = get_message(mutex_queue, id, len);
+                if (current_payload_in_task_queue)
+                    at_payload = true;
+                else if(get_message(int_queue, id, len))
+                    at_payload = true;
+            if (reader_excluded())
+                ctl_global_interrupts_set(enabled);
             return at_payload;
         }
 
-        void read_current_payload(u8* payload, u32 len)
+        // the payload of the current message, valid until message_done
+        const u8* current_payload()
         {
-            assert(payload);
             assert(at_payload);
-            u32 size;
-            if (current_payload_in_task_queue) size = mutex_queue.awaiting();
-            else                               size = int_queue.awaiting();
+            if (current_shared)                return current_shared;
+            if (current_payload_in_task_queue) return mutex_queue.get_read_pointer();
+            else                               return int_queue.get_read_pointer();
+        }
 
-            assert(size >= len);
-            if (current_payload_in_task_queue) mutex_queue.read_buffer(payload, len, true);
-            else                               int_queue.read_buffer(payload, len, true);
+        void read_current_payload(u8* payload, u32 len)
+        {
+            assert(payload);
+            memcpy(payload, current_payload(), len);
         }
 
         void message_done(u32 len)
         {
-            u32 packing = (sizeof(u32) - (len & 0x3)) & 0x3;
-            len += packing;
-            if (current_payload_in_task_queue) mutex_queue.advance_read_pointer(len);
-            else                               int_queue.advance_read_pointer(len);
-            at_payload = false;
+            const u8* done_shared = current_shared;
+            len = record_len(current_shared ? sizeof(current_shared) : len) - sizeof(header);
+            int enabled = reader_excluded() ? ctl_global_interrupts_set(0) : 0;
+                if (current_payload_in_task_queue) mutex_queue.advance_read_pointer(len);
+                else                               int_queue.advance_read_pointer(len);
+                at_payload = false;
+                current_shared = 0;
+            if (reader_excluded())
+                ctl_global_interrupts_set(enabled);
+
+            if (done_shared)
+                shared_payloads->release(done_shared);
+            if (overflow::block == policy)
+                ctl_events_set_clear(&room_event, room_flag, 0);
         }
 
     private:
+        typedef ring_buffer_base<u8, volatile u8*> ring;
+
+        // len is the one written in the header, stored_len the bytes actually held in the ring
+        u8* reserve_record(u32 id, u32 len, u32 stored_len, overflow_report* report)
+        {
+            assert(id != skip_id);
+
+            u32 total_len = record_len(stored_len);
+            volatile u8* record = 0;
+            bool from_interrupt = ctl_interrupt_count; // interrupts have their own ring, never wait
+            ring& r = from_interrupt ? int_queue : mutex_queue;
+            bool blocking = (overflow::block == policy) && !from_interrupt;
+            CTL_TIME_t deadline = blocking ? ctl_get_current_time() + blocking_timeout : 0;
+            overflow_report outcome = { overflow_outcome::none, 0 };
+
+            // sending from non-interrupts without lock_free, must protect ourselves against task switches until the commit
+            if (!lock_free && !from_interrupt)
+                ctl_mutex_lock(&write_mutex, CTL_TIMEOUT_INFINITE, 0);
+
+            while (true)
+            {
+                if (blocking)
+                    ctl_events_set_clear(&room_event, 0, room_flag); // any room made from now on wakes us up
+
+                // the claim excludes the other writers and, since the overflow policies may move the read pointer, the reader
+                int enabled = ctl_global_interrupts_set(0);
+                    record = claim(r, id, len, total_len);
+                    if (!record && overflow::drop_oldest == policy)
+                    {
+                        outcome.lost = evict(r, total_len); // may be none, when only a skip record was in the way
+                        if (outcome.lost)
+                            outcome.outcome = overflow_outcome::evicted;
+                        record = claim(r, id, len, total_len);
+                    }
+                    else if (!record && overflow::coalesce == policy && coalesces(id) && !(len & shared)) // overwriting a reference would leak it
+                    {
+                        record = find_pending(r, id, len);
+                        if (record)
+                        {
+                            outcome.outcome = overflow_outcome::coalesced;
+                            outcome.lost = 1;
+                        }
+                    }
+                ctl_global_interrupts_set(enabled);
+
+                if (record || !blocking)
+                    break;
+                if (static_cast<s32>(ctl_get_current_time() - deadline) >= 0)
+                    break;
+                ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS, &room_event, room_flag, CTL_TIMEOUT_ABSOLUTE, deadline);
+            }
+
+            if (!record)
+            {
+                outcome.outcome = blocking ? overflow_outcome::timed_out : overflow_outcome::dropped;
+                ++outcome.lost;
+            }
+
+          #if ENABLE_MESSAGE_STATS
+            if (overflow_outcome::coalesced == outcome.outcome)
+                ++stats.coalesced;
+            else
+                (from_interrupt ? stats.int_drops : stats.task_drops) += outcome.lost;
+          #endif
+            if (report)
+                *report = outcome;
+
+            if (!record)
+            {
+                if (!lock_free && !from_interrupt)
+                    ctl_mutex_unlock(&write_mutex);
+                return 0;
+            }
+            return const_cast<u8*>(record) + sizeof(header);
+        }
+
         struct header
         {
             u32 id;
-            u32 len; // must be multiple of 4 bytes
+            u32 len; // of the payload, without the padding up to the next record
+          #if ENABLE_MESSAGE_STATS
+            u64 sent_time; // system time of the commit
+          #endif
         };
-        BOOST_STATIC_ASSERT((sizeof(header) & 0x3) == 0);
+        BOOST_STATIC_ASSERT((sizeof(header) & (alignment - 1)) == 0);
+        static const u32 skip_id = 0xffffffff; // the rest of the ring is padding, the next record is at its start
+        static const u32 unpublished = 0x80000000; // flag in the len : the space is claimed, the payload is still being written
+        static const u32 shared = 0x40000000; // flag in the len : the ring holds a pointer to the payload, in the payload slab
 
-        bool get_task_message(u32& id, u32& len)
+        static const CTL_EVENT_SET_t room_flag = 1 << 0;
+
+        static u32 record_len(u32 len)
         {
-            header h;
-            bool enough = mutex_queue.read_buffer(reinterpret_cast<u8*>(&h), sizeof(header), true);
-            if (!enough)
-                return false;
-            u32 size = mutex_queue.awaiting();
-            if (sizeof(header) + h.len > size)
-                return false;
-            id = h.id;
-            len = h.len;
-            mutex_queue.advance_read_pointer(sizeof(header));
-            return true;
+            return (sizeof(header) + len + alignment - 1) & ~(alignment - 1);
         }
 
-        bool get_int_message(u32& id, u32& len)
+        static u32 stored_len(u32 header_len)
         {
-            header h;
-            bool enough = int_queue.read_buffer(reinterpret_cast<u8*>(&h), sizeof(header), true);
-            if (!enough)
-                return false;
-            u32 size = int_queue.awaiting();
-            if (sizeof(header) + h.len > size)
-                return false;
-            id = h.id;
-            len = h.len;
-            int_queue.advance_read_pointer(sizeof(header));
-            return true;
+            return (header_len & shared) ? sizeof(const u8*) : (header_len & ~unpublished);
+        }
+
+        bool coalesces(u32 id)
+        {
+            return id < 32 && (coalesced_ids & (1 << id));
+        }
+
+        bool reader_excluded() // when the writers may move the read pointer or modify a message
+        {
+            return overflow::drop_oldest == policy || overflow::coalesce == policy || coalesced_ids;
+        }
+
+        bool reading(ring& r)
+        {
+            return at_payload && (&r == (current_payload_in_task_queue ? &mutex_queue : &int_queue));
+        }
+
+        // with the writers and the reader excluded. removes the oldest published messages until total_len fits, returns how many
+        u32 evict(ring& r, u32 total_len)
+        {
+            if (reading(r)) // the read pointer is inside the current message
+                return 0;
+
+            u32 until_wrap = r.write_until_wrap();
+            u32 needed = ((until_wrap < total_len) ? until_wrap : 0) + total_len;
+            u32 lost = 0;
+            while (r.free() < needed && r.awaiting())
+            {
+                volatile header* h = reinterpret_cast<volatile header*>(r.get_read_pointer());
+                if (skip_id == h->id)
+                {
+                    r.advance_read_pointer(r.read_until_wrap());
+                    continue;
+                }
+                u32 l = h->len;
+                if (l & unpublished) // being written, the ones after it as well maybe
+                    break;
+                if (l & shared)
+                    shared_payloads->release(*reinterpret_cast<const u8* volatile*>(r.get_read_pointer() + sizeof(header)));
+                r.advance_read_pointer(record_len(stored_len(l)));
+                ++lost;
+            }
+            return lost;
+        }
+
+        // with the writers and the reader excluded. a published message of this id and length, made unpublished again so the sender
+        // can overwrite it, or 0
+        volatile u8* find_pending(ring& r, u32 id, u32 len)
+        {
+            volatile u8* p = find_published(r, id, len);
+            if (p)
+                reinterpret_cast<volatile header*>(p)->len = len | unpublished;
+            return p;
+        }
+
+        // with the writers and the reader excluded. the oldest published message of this id and length still awaiting the reader, or 0
+        volatile u8* find_published(ring& r, u32 id, u32 len)
+        {
+            volatile u8* begin = r.get_buffer();
+            volatile u8* end = begin + r.get_size();
+            volatile u8* p = r.get_read_pointer();
+            u32 left = r.awaiting();
+            if (reading(r)) // past the current message, the reader is looking at it
+            {
+                u32 rest = record_len(current_shared ? sizeof(current_shared) : current_len) - sizeof(header);
+                p += rest;
+                left -= rest;
+            }
+
+            while (left)
+            {
+                if (p == end)
+                    p = begin;
+                volatile header* h = reinterpret_cast<volatile header*>(p);
+                if (skip_id == h->id)
+                {
+                    left -= end - p;
+                    p = begin;
+                    continue;
+                }
+                u32 l = h->len;
+                if (id == h->id && len == l)
+                    return p;
+                p += record_len(stored_len(l));
+                left -= record_len(stored_len(l));
+            }
+            return 0;
+        }
+
+        // with the writers excluded. leaves the message unpublished
+        volatile u8* claim(ring& r, u32 id, u32 len, u32 total_len)
+        {
+            u32 until_wrap = r.write_until_wrap();
+            u32 skipped = (until_wrap < total_len) ? until_wrap : 0;
+            if (r.free() < skipped + total_len)
+                return 0;
+
+            if (skipped)
+            {
+                reinterpret_cast<volatile header*>(r.get_write_pointer())->id = skip_id;
+                r.advance_write_pointer(skipped);
+            }
+
+            volatile u8* record = r.get_write_pointer();
+            volatile header* h = reinterpret_cast<volatile header*>(record);
+            h->id = id;
+            h->len = len | unpublished;
+            __asm__ __volatile__ ("" ::: "memory"); // the header is in place before the reader may see the space claimed
+            r.advance_write_pointer(total_len);
+          #if ENABLE_MESSAGE_STATS
+            u32& high_water = (&r == &int_queue) ? stats.int_high_water : stats.task_high_water;
+            if (r.awaiting() > high_water)
+                high_water = r.awaiting();
+          #endif
+            return record;
+        }
+
+        bool get_message(ring& r, u32& id, u32& len)
+        {
+            while (r.awaiting())
+            {
+                volatile header* h = reinterpret_cast<volatile header*>(r.get_read_pointer());
+                if (skip_id == h->id)
+                {
+                    r.advance_read_pointer(r.read_until_wrap());
+                    continue;
+                }
+                u32 l = h->len;
+                if (l & unpublished) // its sender signals the event again once done
+                    return false;
+                id = h->id;
+                len = l & ~shared;
+                current_len = len;
+              #if ENABLE_MESSAGE_STATS
+                u64 waited = get_hw_clock().get_system_time() - h->sent_time;
+                current_latency_us = get_hw_clock().system_to_microsec(waited);
+                stats.latency.add(current_latency_us);
+              #endif
+                r.advance_read_pointer(sizeof(header));
+                if (l & shared)
+                    current_shared = *reinterpret_cast<const u8* volatile*>(r.get_read_pointer());
+                return true;
+            }
+            return false;
         }
 
         bool at_payload;
         bool current_payload_in_task_queue;
+        u32 current_len;
+        const u8* current_shared; // the payload of the current message, when in the slab
+
+        payload_slab* shared_payloads;
+        u32 coalesced_ids;
 
-        ring_buffer_base<u8, volatile u8*> mutex_queue;
-        ring_buffer_base<u8, volatile u8*> int_queue;
+        overflow::en policy;
+        CTL_TIME_t blocking_timeout;
+        CTL_EVENT_SET_t room_event;
+
+        ring mutex_queue;
+        ring int_queue;
         CTL_MUTEX_t write_mutex;
         CTL_EVENT_SET_t* queue_event;
         CTL_EVENT_SET_t message_mask;
+      #if ENABLE_MESSAGE_STATS
+        statistics stats;
+        u32 current_latency_us;
+      #endif
     };
-}
\ No newline at end of file
+
+    typedef basic_message_queue<ENABLE_LOCK_FREE_MESSAGES> message_queue;
+}
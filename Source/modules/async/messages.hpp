@@ -1,6 +1,7 @@
 #pragma once
 
 #include "modules/async/message_queue.hpp"
+#include "modules/async/handle_pool.hpp"
 
 namespace msg
 {
@@ -27,7 +28,7 @@ namespace msg
 
             // to aux thread
             shutdown, // the program is ending, shut down the board please
-            timepulse,
+            timepulse, // a notification, see central::notify
             battery_level_request,
             serial_number_request,
             battery_info_request,
@@ -44,7 +45,7 @@ namespace msg
 
             // to gps processor thread
             proximity_detected,
-            zigbee_not_cts,
+            zigbee_not_cts, // a notification, see central::notify
 
             // general
             battery_level,
@@ -54,8 +55,11 @@ namespace msg
             battery_info, // battery info reply
             charger_info, // charger info reply
             auxctl_info, // auxiliary controller info reply
+            message_overflow, // a queue had no room for a message, see payload::message_overflow
+            request_timeout, // a request sent through central::request got no reply in time, see payload::request_timeout
 
             // sink mechanism's internal events
+            reply, // the reply to a request sent through central::request, unwrapped by the sink, see payload::reply
             timeout, // the wait statement used to await messages timed out
             request_to_end_task, // terminate the thread
 
@@ -65,12 +69,15 @@ namespace msg
     }
 
     namespace payload {
+        typedef async::notification notification; // the payload of the ids sent through central::notify
+
         namespace time_event_types {
             enum en
             {
                 invalid,
                 once,
-                repeating,
+                repeating,         // every period ms from next_time_ms, whatever the time taken to handle each
+                timepulse_aligned, // every period ms, phase ms after the GPS timepulse. runs as repeating while there is no timepulse
             };
         }
         struct enqueue_time_event
@@ -80,6 +87,15 @@ namespace msg
             time_event_types::en type;
             u32 next_time_ms;
             u32 period;
+            u32 phase; // for timepulse_aligned, in ms, below period
+            u32 slack; // ms the event may be sent late, to go out with other events due about then, see time_queue::queue
+            u32 correlation; // 0, or the request expiring at next_time_ms, see central::request. message and dest are then ignored
+            u32 handle; // from central::schedule, 0 to let the time_queue take one
+        };
+
+        struct kill_time_event
+        {
+            u32 handle; // of an event still scheduled, ignored otherwise
         };
 
         struct proximity_detected
@@ -129,30 +145,75 @@ namespace msg
             u16 stkerrlst;
             u16 spierror;
         };
+
+        struct message_overflow
+        {
+            msg::src::en queue;
+            msg::id::en message; // the one being sent
+            async::overflow_outcome::en outcome;
+            u32 lost; // messages
+        };
+
+        // the payload of the requests sent through central::request. a request sent without payload is answered to every listener
+        struct request
+        {
+            u32 correlation;
+            msg::src::en reply_to;
+        };
+
+        // precedes the payload of the reply message of id 'message'
+        struct reply
+        {
+            u32 correlation;
+            msg::id::en message;
+        };
+
+        struct request_timeout
+        {
+            u32 correlation;
+            msg::id::en request;
+        };
     }
 
+    BOOST_STATIC_ASSERT((sizeof(payload::reply) & (async::message_queue::alignment - 1)) == 0); // keeps the reply payload aligned
+
+    static const u32 max_pending_requests = 16; // requests awaiting their reply or their timeout, over all requesters
+    static const u32 max_time_events = 256; // scheduled in the time_queue at once, periodic ones included
+    static const u32 aux_reply_timeout_ms = 500; // the auxiliary controller replies after a few SPI transfers
+
     static const u32 shared_buffer_size = 2048; // must be at least equal to sum of individual queue size defined next
 
+    // global messages going to several queues store their payload once, in a slot, when it is longer than the reference to it
+    static const u32 shared_payload_slots = 8;
+    static const u32 shared_payload_slot_size = 64; // the largest payload shared, longer ones are copied in each queue
+
     struct queue_definition
     {
         src::en to;
         u32 task_size; // size of the queue for messages sent from other tasks
         u32 int_size;  // size of the queue for messages sent from interrupts
+        async::overflow::en overflow; // what to do with a message the queue has no room for
+        u32 block_timeout_ms; // for async::overflow::block
     };
     static const queue_definition queues[] = 
     {
-        {src::main, 64, 64},
-        {src::aux, 64, 64},
-        {src::fs_queue, 128, 128},
-        {src::time_queue, 128, 128},
-        {src::gps_processor, 256, 256},
-        {src::console, 64, 64},
+        {src::main, 64, 64, async::overflow::block, 100},
+        {src::aux, 64, 64, async::overflow::block, 100}, // requests, each one awaited by its requester
+        {src::fs_queue, 128, 128, async::overflow::block, 100},
+        {src::time_queue, 512, 128, async::overflow::block, 100}, // a lost event would never fire. a schedule takes 48 bytes (56 with ENABLE_MESSAGE_STATS) : room for a burst of ten from the tasks
+        {src::gps_processor, 256, 256, async::overflow::drop_oldest, 0}, // mostly status replies, never stalls the aux and time queue tasks
+        {src::console, 64, 64, async::overflow::drop_oldest, 0},
     };
 
+    // ids sent from interrupts on every edge, which only need handling once until handled : a pending notification is updated
+    // rather than queueing a new one, see async::message_queue::notify. the only ids an overflow::coalesce queue would merge
+    static const id::en coalesced_notifications[] = { id::timepulse, id::zigbee_not_cts };
+    BOOST_STATIC_ASSERT(id::none <= 32); // a bit per id
+
     class central
     {
     public:
-        central() : system_shutdown(false) {}
+        central() : next_correlation(1), system_shutdown(false) {}
 
         void init()
         {
@@ -161,11 +222,27 @@ namespace msg
 
             memset(queue_lookup, 0, sizeof(queue_lookup));
             memset(global_listeners, 0, sizeof(global_listeners));
+            memset(pending_requests, 0, sizeof(pending_requests));
+            time_events.init();
+            late_replies = 0;
+            ctl_mutex_init(&request_mutex);
+          #if ENABLE_MESSAGE_STATS
+            memset(id_latency, 0, sizeof(id_latency));
+          #endif
+
+            shared_payloads.init(shared_payload_buffer, shared_payload_references, shared_payload_slots, shared_payload_slot_size);
+
+            u32 coalesced_ids = 0;
+            for (u32 i = 0; i < sizeof(coalesced_notifications) / sizeof(id::en); ++i)
+                coalesced_ids |= 1 << coalesced_notifications[i];
 
             for (u32 q = 0; q < queue_count; ++q)
             {
                 assert(buffer < shared_buffer + shared_buffer_size);
                 queue_table[q].init(buffer, queues[q].task_size, queues[q].int_size);
+                queue_table[q].set_payload_slab(&shared_payloads);
+                queue_table[q].set_coalescing(coalesced_ids);
+                queue_table[q].set_overflow_policy(queues[q].overflow, queues[q].block_timeout_ms * ctl_get_ticks_per_second() / 1000);
                 queue_lookup[queues[q].to] = &queue_table[q];
                 buffer += queues[q].task_size + queues[q].int_size;
             }
@@ -184,10 +261,50 @@ namespace msg
         }
 
         void send_message(src::en to, id::en message_id, u16 len = 0, u8* payload = 0)
+        {
+            assert((len == 0 && payload == 0) || (len && payload));
+            u8* p = reserve(to, message_id, len);
+            if (!p)
+                return;
+            if (len)
+                memcpy(p, payload, len);
+            commit(to, p);
+        }
+
+        // builds the payload in place : fill the len bytes returned, then commit them. 0 if the queue is full. if the queue's overflow
+        // policy had to act, a message_overflow is sent to its listeners
+        u8* reserve(src::en to, id::en message_id, u16 len)
+        {
+            async::message_queue* queue = queue_lookup[to];
+            assert(queue);
+            async::overflow_report report;
+            u8* p = queue->reserve(message_id, len, &report);
+            notify_overflow(to, message_id, report);
+            return p;
+        }
+
+        template <typename payload_t>
+        payload_t* reserve(src::en to, id::en message_id)
+        {
+            BOOST_STATIC_ASSERT(__alignof__(payload_t) <= async::message_queue::alignment);
+            return reinterpret_cast<payload_t*>(reserve(to, message_id, sizeof(payload_t)));
+        }
+
+        void commit(src::en to, void* payload)
+        {
+            async::message_queue* queue = queue_lookup[to];
+            assert(queue);
+            queue->commit(static_cast<u8*>(payload));
+        }
+
+        // sends a payload::notification, merged into the one still pending if the id is in coalesced_notifications
+        void notify(src::en to, id::en message_id)
         {
             async::message_queue* queue = queue_lookup[to];
             assert(queue);
-            queue->send_message(message_id, len, payload);
+            async::overflow_report report;
+            queue->notify(message_id, &report);
+            notify_overflow(to, message_id, report);
         }
 
         void send_global_message(id::en message_id, u16 len = 0, u8* payload = 0)
@@ -195,13 +312,36 @@ namespace msg
             u32 mask = global_listeners[message_id];
             if (!mask)
                 return;
+
+            u32 listeners = 0;
+            for (u32 i = 0; i < src::none; ++i)
+                if (mask & (1 << i))
+                    ++listeners;
+
+            // copied once in a slot, each queue gets a reference. when the slots run out, each queue gets its copy as usual
+            u8* shared = (listeners > 1 && len > sizeof(u8*)) ? shared_payloads.allocate(len, listeners) : 0;
+            if (shared)
+            {
+                memcpy(shared, payload, len);
+                for (u32 i = 0; i < src::none; ++i)
+                {
+                    if (mask & (1 << i))
+                    {
+                        async::message_queue* queue = queue_lookup[i];
+                        assert(queue);
+                        async::overflow_report report;
+                        queue->send_shared(message_id, len, shared, &report);
+                        notify_overflow(static_cast<src::en>(i), message_id, report);
+                    }
+                }
+                return;
+            }
+
             for (u32 i = 0; i < src::none; ++i)
             {
                 if (mask & (1 << i))
                 {
-                    async::message_queue* queue = queue_lookup[i];
-                    assert(queue);
-                    queue->send_message(message_id, len, payload);
+                    send_message(static_cast<src::en>(i), message_id, len, payload);
                 }
             }
         }
@@ -210,12 +350,24 @@ namespace msg
         {
             async::message_queue* queue = queue_lookup[to];
             assert(queue);
-            u32 temp;
+            u32 temp = id::none;
             bool ok = queue->get_message(temp, len);
             msg_id = static_cast<id::en>(temp);
+          #if ENABLE_MESSAGE_STATS
+            if (ok && temp < id::none)
+                id_latency[temp].add(queue->current_latency());
+          #endif
             return ok;
         }
 
+        // a view of the current payload inside the queue, valid until message_done
+        const u8* current_payload(src::en to)
+        {
+            async::message_queue* queue = queue_lookup[to];
+            assert(queue);
+            return queue->current_payload();
+        }
+
         void read_current_payload(src::en to, u8* payload, u32 len)
         {
             async::message_queue* queue = queue_lookup[to];
@@ -230,14 +382,245 @@ namespace msg
             return queue->message_done(len);
         }
 
+        // sends request_id to 'to' with a payload::request. the reply goes to reply_to only, as a reply message, which its sink dispatches
+        // like the message replied. if none came within timeout_ms, reply_to gets a request_timeout instead, through the time_queue.
+        // returns the correlation of the request, 0 if it could not be sent. from tasks only
+        u32 request(src::en to, id::en request_id, src::en reply_to, u32 timeout_ms)
+        {
+            assert(!ctl_interrupt_count);
+            u32 correlation = 0;
+            ctl_mutex_lock(&request_mutex, CTL_TIMEOUT_INFINITE, 0);
+                for (u32 i = 0; i < max_pending_requests; ++i)
+                {
+                    if (!pending_requests[i].correlation)
+                    {
+                        correlation = next_correlation++;
+                        if (!next_correlation)
+                            next_correlation = 1;
+                        pending_requests[i].correlation = correlation;
+                        pending_requests[i].reply_to = reply_to;
+                        pending_requests[i].request = request_id;
+                        pending_requests[i].expiry = 0;
+                        break;
+                    }
+                }
+            ctl_mutex_unlock(&request_mutex);
+            if (!correlation) // too many requests awaiting
+                return 0;
+
+            payload::request* r = reserve<payload::request>(to, request_id);
+            if (!r)
+            {
+                forget_request(correlation);
+                return 0;
+            }
+            r->correlation = correlation;
+            r->reply_to = reply_to;
+            commit(to, r);
+
+            // should the time_queue be full, the request waits for its reply as long as it takes. the timeout may come an eighth late
+            u32 expiry = schedule_event(reply_to, id::request_timeout, timeout_ms, 0, correlation, timeout_ms / 8);
+            if (expiry)
+            {
+                ctl_mutex_lock(&request_mutex, CTL_TIMEOUT_INFINITE, 0);
+                    pending_request* p = find_request(correlation);
+                    if (p) // unless already replied to
+                        p->expiry = expiry;
+                ctl_mutex_unlock(&request_mutex);
+            }
+            return correlation;
+        }
+
+        // from the observer of a request : the reply goes to the requester only, or to every listener of reply_id for a request sent
+        // without payload. a reply coming after the timeout of its request is dropped
+        void reply(const payload::request& to_request, id::en reply_id, u16 len = 0, u8* payload = 0)
+        {
+            if (!to_request.correlation)
+            {
+                send_global_message(reply_id, len, payload);
+                return;
+            }
+            u32 expiry = 0;
+            if (!forget_request(to_request.correlation, &expiry))
+            {
+                ++late_replies;
+                return;
+            }
+            if (expiry)
+                cancel_scheduled(expiry);
+
+            payload::reply* r = reinterpret_cast<payload::reply*>(reserve(to_request.reply_to, id::reply, sizeof(payload::reply) + len));
+            if (!r)
+                return;
+            r->correlation = to_request.correlation;
+            r->message = reply_id;
+            if (len)
+                memcpy(r + 1, payload, len);
+            commit(to_request.reply_to, r);
+        }
+
+        // from the time_queue, once the timeout of a request is reached
+        void expire_request(u32 correlation)
+        {
+            payload::request_timeout expired;
+            src::en requester = src::none;
+            ctl_mutex_lock(&request_mutex, CTL_TIMEOUT_INFINITE, 0);
+                pending_request* p = find_request(correlation);
+                if (p)
+                {
+                    expired.correlation = correlation;
+                    expired.request = p->request;
+                    requester = p->reply_to;
+                    p->correlation = 0;
+                }
+            ctl_mutex_unlock(&request_mutex);
+
+            if (src::none != requester) // or already replied to
+                send_message(requester, id::request_timeout, sizeof(expired), reinterpret_cast<u8*>(&expired));
+        }
+
+        // false once the request was replied to or timed out
+        bool is_pending(u32 correlation)
+        {
+            ctl_mutex_lock(&request_mutex, CTL_TIMEOUT_INFINITE, 0);
+                bool pending = 0 != find_request(correlation);
+            ctl_mutex_unlock(&request_mutex);
+            return pending;
+        }
+
+        u32 get_late_replies() { return late_replies; }
+
+        // sends message_id to dest in delay_ms, then every period_ms if not 0, each time up to slack_ms late. returns the handle cancel_scheduled
+        // takes, 0 if the time_queue has no room for it
+        u32 schedule(src::en dest, id::en message_id, u32 delay_ms, u32 period_ms = 0, u32 slack_ms = 0)
+        {
+            return schedule_event(dest, message_id, delay_ms, period_ms, 0, slack_ms);
+        }
+
+        // sends message_id to dest every period_ms, phase_ms after the GPS timepulse : with period_ms a multiple of 1000, at the same point of
+        // every GPS second, up to slack_ms late. returns the handle cancel_scheduled takes, 0 if the time_queue has no room for it
+        u32 schedule_on_timepulse(src::en dest, id::en message_id, u32 period_ms, u32 phase_ms = 0, u32 slack_ms = 0)
+        {
+            assert(period_ms && phase_ms < period_ms);
+            return schedule_event(dest, message_id, period_ms, period_ms, 0, slack_ms, phase_ms, payload::time_event_types::timepulse_aligned);
+        }
+
+        // the event is not sent anymore, unless it is already on its way. a handle whose event is over is ignored
+        void cancel_scheduled(u32 handle)
+        {
+            payload::kill_time_event* kill = reserve<payload::kill_time_event>(src::time_queue, id::kill_time_event);
+            if (!kill)
+                return;
+            kill->handle = handle;
+            commit(src::time_queue, kill);
+        }
+
+        // the handles of the time_queue events, released by the time_queue once an event is over
+        async::handle_pool<max_time_events>& get_time_events() { return time_events; }
+
+      #if ENABLE_MESSAGE_STATS
+        async::payload_slab& get_shared_payloads() { return shared_payloads; }
+
+        const async::message_queue::statistics* get_queue_stats(src::en to)
+        {
+            async::message_queue* queue = queue_lookup[to];
+            return queue ? &queue->get_stats() : 0;
+        }
+
+        const async::latency_histogram& get_id_latency(id::en message_id) { return id_latency[message_id]; }
+      #endif
+
         void request_system_shutdown() { system_shutdown = true; }
         bool system_shutdown_requested() { return system_shutdown; }
 
     private:
+        void notify_overflow(src::en to, id::en message_id, const async::overflow_report& report)
+        {
+            if (async::overflow_outcome::none == report.outcome || id::message_overflow == message_id) // never about itself, it could loop
+                return;
+            payload::message_overflow notification;
+            notification.queue = to;
+            notification.message = message_id;
+            notification.outcome = report.outcome;
+            notification.lost = report.lost;
+            send_global_message(id::message_overflow, sizeof(notification), reinterpret_cast<u8*>(&notification));
+        }
+
+        u32 schedule_event(src::en dest, id::en message_id, u32 delay_ms, u32 period_ms, u32 correlation, u32 slack_ms = 0, u32 phase_ms = 0,
+                           payload::time_event_types::en type = payload::time_event_types::invalid)
+        {
+            u32 handle = time_events.allocate();
+            if (!handle)
+                return 0;
+            payload::enqueue_time_event* ev = reserve<payload::enqueue_time_event>(src::time_queue, id::enqueue_time_event);
+            if (!ev)
+            {
+                time_events.release(handle);
+                return 0;
+            }
+            ev->message = message_id;
+            ev->dest = dest;
+            if (payload::time_event_types::invalid == type)
+                type = period_ms ? payload::time_event_types::repeating : payload::time_event_types::once;
+            ev->type = type;
+            ev->next_time_ms = get_hw_clock().get_millisec_time() + delay_ms;
+            ev->period = period_ms;
+            ev->phase = phase_ms;
+            ev->slack = slack_ms;
+            ev->correlation = correlation;
+            ev->handle = handle;
+            commit(src::time_queue, ev);
+            return handle;
+        }
+
+        struct pending_request
+        {
+            u32 correlation; // 0 for a free entry
+            src::en reply_to;
+            id::en request;
+            u32 expiry; // the handle of its timeout event
+        };
+
+        // with request_mutex held
+        pending_request* find_request(u32 correlation)
+        {
+            assert(correlation);
+            for (u32 i = 0; i < max_pending_requests; ++i)
+                if (correlation == pending_requests[i].correlation)
+                    return &pending_requests[i];
+            return 0;
+        }
+
+        // false if the request was not pending anymore
+        bool forget_request(u32 correlation, u32* expiry = 0)
+        {
+            ctl_mutex_lock(&request_mutex, CTL_TIMEOUT_INFINITE, 0);
+                pending_request* p = find_request(correlation);
+                if (p)
+                {
+                    p->correlation = 0;
+                    if (expiry)
+                        *expiry = p->expiry;
+                }
+            ctl_mutex_unlock(&request_mutex);
+            return p != 0;
+        }
+
         async::message_queue queue_table[sizeof(queues) / sizeof(queue_definition)];
         async::message_queue* queue_lookup[src::none];
-        u8 shared_buffer[shared_buffer_size];
+        u8 shared_buffer[shared_buffer_size] __attribute__ ((aligned (8))); // see async::message_queue::alignment
+        async::payload_slab shared_payloads;
+        u8 shared_payload_buffer[shared_payload_slots * shared_payload_slot_size] __attribute__ ((aligned (8)));
+        u8 shared_payload_references[shared_payload_slots];
         u32 global_listeners[id::none];
+      #if ENABLE_MESSAGE_STATS
+        async::latency_histogram id_latency[id::none];
+      #endif
+        pending_request pending_requests[max_pending_requests];
+        async::handle_pool<max_time_events> time_events;
+        CTL_MUTEX_t request_mutex;
+        u32 next_correlation;
+        u32 late_replies;
         volatile bool system_shutdown;
     };
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "armtastic/types.hpp"
+#include "assert.h"
+#include <ctl_api.h>
+
+namespace async
+{
+    // fixed size slots holding a payload shared by several message queues. each queue holding the payload holds a reference, the slot is free
+    // again once the last one is released. allocations and releases are short sections with interrupts disabled, so interrupts may use it.
+    class payload_slab
+    {
+    public:
+        void init(u8* buffer, u8* reference_counts, u32 count, u32 size)
+        {
+            assert(buffer);
+            assert(reference_counts);
+            assert(count);
+            slots = buffer;
+            references = reference_counts;
+            slot_count = count;
+            slot_size = size;
+            for (u32 i = 0; i < slot_count; ++i)
+                references[i] = 0;
+            next = 0;
+            in_use = high_water = exhausted = 0;
+        }
+
+        // a slot for len bytes, held by reference_count queues, or 0 if none is free
+        u8* allocate(u32 len, u32 reference_count)
+        {
+            assert(reference_count && reference_count < 256);
+            if (len > slot_size)
+                return 0;
+
+            u8* slot = 0;
+            int enabled = ctl_global_interrupts_set(0);
+                for (u32 tried = 0; tried < slot_count; ++tried)
+                {
+                    u32 i = next;
+                    next = (next + 1 == slot_count) ? 0 : next + 1;
+                    if (!references[i])
+                    {
+                        references[i] = reference_count;
+                        slot = slots + i * slot_size;
+                        if (++in_use > high_water)
+                            high_water = in_use;
+                        break;
+                    }
+                }
+                if (!slot)
+                    ++exhausted;
+            ctl_global_interrupts_set(enabled);
+            return slot;
+        }
+
+        void release(const u8* slot)
+        {
+            u32 i = (slot - slots) / slot_size;
+            assert(i < slot_count && slots + i * slot_size == slot);
+            int enabled = ctl_global_interrupts_set(0);
+                assert(references[i]);
+                if (0 == --references[i])
+                    --in_use;
+            ctl_global_interrupts_set(enabled);
+        }
+
+        u32 get_slot_size() { return slot_size; }
+        u32 get_slot_count() { return slot_count; }
+        u32 get_high_water() { return high_water; } // slots
+        u32 get_exhausted() { return exhausted; }   // allocations refused, the payload was then copied in each queue
+
+    private:
+        u8* slots;
+        u8* references;
+        u32 slot_count;
+        u32 slot_size;
+        u32 next;
+        u32 in_use;
+        u32 high_water;
+        u32 exhausted;
+    };
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "modules/init/project.hpp"
+#include "modules/init/globals.hpp"
+#include "dev/clock_lpc3230.hpp"
+#include "assert.h"
+#include <string.h>
+#include <ctl_api.h>
+
+namespace async
+{
+    namespace operation_mode
+    {
+        enum en
+        {
+            wait,    // until the job is over
+            timeout, // at most the timeout given
+            poll,    // not at all
+        };
+    }
+
+    namespace status
+    {
+        enum en
+        {
+            unstarted,
+            pending,   // queued or running
+            done,
+            timed_out, // the wait ended before the job, which is still pending
+            cancelled,
+        };
+    }
+
+    class worker_pool;
+
+    // a computation handed to the worker_pool. the object must live until the job is over : done, or cancelled while still queued.
+    // wait is the future : it blocks on the job's event, so any number of tasks may wait on the same job. the job is over only once its
+    // event is set, the state alone is no proof : the worker still sets the event after the final state.
+    class job
+    {
+    public:
+        job() : state(status::unstarted), cancelling(false), priority(0), next(0), start_time(0), end_time(0)
+        {
+            ctl_events_init(&event_done, 0);
+        }
+        virtual ~job() {}
+
+        status::en get_status()
+        {
+            if (status::unstarted == state || (event_done & done_flag))
+                return state;
+            return status::pending; // maybe finishing
+        }
+
+        status::en wait(operation_mode::en op_mode = operation_mode::wait, u32 timeout_ms = 0)
+        {
+            if (status::unstarted == state)
+                return state;
+
+            CTL_TIMEOUT_t timeout_type = CTL_TIMEOUT_NONE;
+            CTL_TIME_t timeout = 0;
+            if (operation_mode::timeout == op_mode)
+            {
+                timeout_type = CTL_TIMEOUT_DELAY;
+                timeout = timeout_ms * ctl_get_ticks_per_second() / 1000;
+            }
+            else if (operation_mode::poll == op_mode)
+                timeout_type = CTL_TIMEOUT_NOW;
+
+            if (!ctl_events_wait(CTL_EVENT_WAIT_ALL_EVENTS, &event_done, done_flag, timeout_type, timeout))
+                return status::timed_out;
+            return state;
+        }
+
+        u32 runtime_ms()
+        {
+            return static_cast<u32>(runtime_us() / 1000);
+        }
+
+        us runtime_us() // so far if still running
+        {
+            if (!start_time)
+                return 0;
+            u64 elapsed = (end_time ? end_time : get_hw_clock().get_system_time()) - start_time;
+            return get_hw_clock().system_to_microsec(elapsed);
+        }
+
+    protected:
+        virtual void run() = 0;
+        virtual void cancelled() {} // from the worker if the job was cancelled while running, from the canceller otherwise
+
+        // a long run should poll this from time to time, and give up when it turns true
+        bool cancel_requested() { return cancelling; }
+
+    private:
+        friend class worker_pool;
+
+        static const CTL_EVENT_SET_t done_flag = 1 << 0;
+
+        CTL_EVENT_SET_t event_done;
+        volatile status::en state;
+        volatile bool cancelling;
+        u8 priority;
+        job* next; // in the pool's pending list
+        volatile u64 start_time;
+        volatile u64 end_time;
+    };
+
+    // a fixed set of tasks, created once, running the jobs submitted to them : highest priority first, in submission order among equals.
+    // the jobs run at the workers' task priority, which should be below the time critical tasks.
+    class worker_pool
+    {
+    public:
+        static const u32 worker_count = 2;
+        static const u32 stack_size = 1024; // words, per worker
+
+        void start(u8 thread_priority)
+        {
+            ctl_mutex_init(&lock);
+            ctl_semaphore_init(&available, 0);
+            pending = 0;
+            stopping = false;
+            submitted = completed = 0;
+            for (u32 w = 0; w < worker_count; ++w)
+            {
+                memset(stacks[w], 0xbe, sizeof(stacks[w])); // init the stack to a recognizable value
+                ctl_task_run(&workers[w], thread_priority, static_worker, this, "worker", stack_size, (unsigned int*)stacks[w], 0);
+            }
+        }
+
+        // the jobs still queued are cancelled, the ones running are waited for
+        void stop()
+        {
+            ctl_mutex_lock(&lock, CTL_TIMEOUT_INFINITE, 0);
+                stopping = true;
+                while (pending)
+                {
+                    job* j = pending;
+                    pending = j->next;
+                    finish(*j, status::cancelled);
+                }
+            ctl_mutex_unlock(&lock);
+
+            for (u32 w = 0; w < worker_count; ++w)
+                ctl_semaphore_signal(&available);
+            for (u32 w = 0; w < worker_count; ++w)
+            {
+                while (CTL_STATE_SUSPENDED != workers[w].state)
+                    ctl_timeout_wait(ctl_get_current_time() + 1);
+                ctl_task_remove(&workers[w]);
+            }
+        }
+
+        // false if the job is not over yet or the pool is stopping. as for get_status, the final state is no proof : the worker still
+        // sets the event after it, which would wake the waiters of the new run before it ran
+        bool submit(job& j, u8 priority = 0)
+        {
+            ctl_mutex_lock(&lock, CTL_TIMEOUT_INFINITE, 0);
+                bool accepted = !stopping && (status::unstarted == j.state || (j.event_done & job::done_flag));
+                if (accepted)
+                {
+                    ctl_events_init(&j.event_done, 0);
+                    j.state = status::pending;
+                    j.cancelling = false;
+                    j.priority = priority;
+                    j.start_time = j.end_time = 0;
+
+                    job** at = &pending;
+                    while (*at && (*at)->priority >= priority)
+                        at = &(*at)->next;
+                    j.next = *at;
+                    *at = &j;
+                    ++submitted;
+                }
+            ctl_mutex_unlock(&lock);
+
+            if (accepted)
+                ctl_semaphore_signal(&available);
+            return accepted;
+        }
+
+        // a queued job never runs and is over when this returns. a running one is only asked to stop (see job::cancel_requested),
+        // it is over once its waiters wake up. returns true in the first case
+        bool cancel(job& j)
+        {
+            bool removed = false;
+            ctl_mutex_lock(&lock, CTL_TIMEOUT_INFINITE, 0);
+                for (job** at = &pending; *at; at = &(*at)->next)
+                {
+                    if (*at == &j)
+                    {
+                        *at = j.next;
+                        removed = true;
+                        break;
+                    }
+                }
+                if (!removed && status::pending == j.state)
+                    j.cancelling = true;
+            ctl_mutex_unlock(&lock);
+
+            if (removed)
+                finish(j, status::cancelled);
+            return removed;
+        }
+
+        u32 get_submitted() { return submitted; }
+        u32 get_completed() { return completed; }
+
+    private:
+        static void static_worker(void* argument)
+        {
+            static_cast<worker_pool*>(argument)->work();
+        }
+
+        void work()
+        {
+            while (true)
+            {
+                ctl_semaphore_wait(&available, CTL_TIMEOUT_NONE, 0);
+
+                ctl_mutex_lock(&lock, CTL_TIMEOUT_INFINITE, 0);
+                    job* j = pending;
+                    if (j)
+                        pending = j->next;
+                    bool stop_now = !j && stopping;
+                ctl_mutex_unlock(&lock);
+
+                if (stop_now)
+                    return;
+                if (!j)
+                    continue;
+
+                j->start_time = get_hw_clock().get_system_time();
+                j->run();
+                j->end_time = get_hw_clock().get_system_time();
+                ctl_mutex_lock(&lock, CTL_TIMEOUT_INFINITE, 0);
+                    ++completed;
+                ctl_mutex_unlock(&lock);
+                finish(*j, j->cancelling ? status::cancelled : status::done);
+            }
+        }
+
+        // the job may be gone as soon as its event is set, the last access to it. its owner sees the final state from then on
+        void finish(job& j, status::en final_state)
+        {
+            j.state = final_state;
+            if (status::cancelled == final_state)
+                j.cancelled();
+            ctl_events_set_clear(&j.event_done, job::done_flag, 0);
+        }
+
+        CTL_MUTEX_t lock; // over the pending list
+        CTL_SEMAPHORE_t available; // a job queued, or the pool stopping
+        job* pending; // by decreasing priority
+        volatile bool stopping;
+        u32 submitted;
+        u32 completed;
+
+        CTL_TASK_t workers[worker_count];
+        u32 stacks[worker_count][stack_size];
+    };
+}
@@ -35,8 +35,21 @@ namespace aux_ctrl
         };
     }
 
-    static const u8 method_observers = 8;
-    class link : public base_sink<link, msg::src::aux, method_observers>
+    // the replies built from a chain of register reads. each request starts its own chain, the chains of a kind end in request order
+    namespace replies
+    {
+        enum en
+        {
+            battery_level,
+            serial_number,
+            battery_info,
+            charger_info,
+            auxctl_info,
+            count,
+        };
+    }
+
+    class link : public base_sink<link, msg::src::aux>
     {
     public:
         link() : rfid_state(rfid_tag_state::idle), shutdown_requested(false) {}
@@ -51,15 +64,6 @@ namespace aux_ctrl
 
             get_int_ctrl().install_service_routine(lpc3230::interrupt::id::aux_ctrl_event, int_priority, fast_irq, lpc3230::interrupt::trigger::positive_edge, static_isr);
             get_int_ctrl().enable_interrupt(lpc3230::interrupt::id::aux_ctrl_event);
-
-            set_method_observer(msg::id::timepulse, &link::time_pulse);
-            set_method_observer(msg::id::shutdown, &link::shutdown);
-            set_method_observer(msg::id::battery_level_request, &link::read_battery_level);
-            set_method_observer(msg::id::serial_number_request, &link::read_serial_number);
-            set_method_observer(msg::id::battery_info_request, &link::read_battery_info);
-            set_method_observer(msg::id::charger_info_request, &link::read_charger_info);
-            set_method_observer(msg::id::auxctl_info_request, &link::read_auxctl_info);
-            set_method_observer(msg::id::clear_charger_faults, &link::clear_charger_faults);
         }
 
         static void static_aux_ctrl_thread(void* argument)
@@ -209,7 +213,7 @@ namespace aux_ctrl
             case AUX_GPR_SERIAL_HI_REG:
                 serial_number |= (static_cast<u32>(data) << 16);
                 serial_num.serial_number = serial_number;
-                get_central().send_global_message(msg::id::serial_number, sizeof(serial_num), reinterpret_cast<u8*>(&serial_num));
+                send_reply(replies::serial_number, msg::id::serial_number, sizeof(serial_num), reinterpret_cast<u8*>(&serial_num));
                 break;
             case AUX_GPR_MINREV_REG:
                 revision::auxiliary_controller_minor = data;
@@ -247,9 +251,10 @@ namespace aux_ctrl
                     prox_msg.time_valid = rfid_tow_valid;
                     get_central().send_global_message(msg::id::proximity_detected, sizeof(prox_msg), reinterpret_cast<u8*>(&prox_msg));
                 }
+                break; // the check sum is no battery level, which would pop a battery_level requester
             case AUX_CHRG_BATTLVL_REG:
                 temp = data;
-                get_central().send_global_message(msg::id::battery_level, sizeof(temp), &temp);
+                send_reply(replies::battery_level, msg::id::battery_level, sizeof(temp), &temp);
                 break;
              case AUX_CHRG_BATTmAh_REG:
                 battery_info_msg.battmah = data;
@@ -261,7 +266,7 @@ namespace aux_ctrl
                 break;
              case AUX_CHRG_BATTSTAT_REG:
                 battery_info_msg.battstat = data;
-                get_central().send_global_message(msg::id::battery_info, sizeof(battery_info_msg), reinterpret_cast<u8*>(&battery_info_msg));
+                send_reply(replies::battery_info, msg::id::battery_info, sizeof(battery_info_msg), reinterpret_cast<u8*>(&battery_info_msg));
                 break;
              case AUX_CHRG_OVRVCUMUL_REG:
                 charger_info_msg.ovrvcumul = data;
@@ -301,7 +306,7 @@ namespace aux_ctrl
                 break;
              case AUX_CHRG_BTDDTEMP_REG:
                 charger_info_msg.btdd_temp = data;
-                get_central().send_global_message(msg::id::charger_info, sizeof(charger_info_msg), reinterpret_cast<u8*>(&charger_info_msg));
+                send_reply(replies::charger_info, msg::id::charger_info, sizeof(charger_info_msg), reinterpret_cast<u8*>(&charger_info_msg));
                 break;
              case AUX_GPR_SYSCLK_LOW_REG:
                 auxctl_info_msg.sysclk = data;
@@ -353,7 +358,7 @@ namespace aux_ctrl
                 break;
              case AUX_GPR_SPIERROR_REG:
                 auxctl_info_msg.spierror = data;
-                get_central().send_global_message(msg::id::auxctl_info, sizeof(auxctl_info_msg), reinterpret_cast<u8*>(&auxctl_info_msg));
+                send_reply(replies::auxctl_info, msg::id::auxctl_info, sizeof(auxctl_info_msg), reinterpret_cast<u8*>(&auxctl_info_msg));
                 break;
             default:
                 break;
@@ -376,16 +381,17 @@ namespace aux_ctrl
             }
         }
 
-        void read_spi(u16 address)
+        // false if the read could not be queued
+        bool read_spi(u16 address)
         {
             if (shutting_down)
-                return;
+                return false;
             assert(op_queue.free());
-            if (op_queue.free())
-            {
-                address &= 0x7FFF;
-                op_queue.write(&address);
-            }
+            if (!op_queue.free())
+                return false;
+            address &= 0x7FFF;
+            op_queue.write(&address);
+            return true;
         }
 
         void write_spi(u16 address, u16 data, bool read_back = false)
@@ -448,9 +454,36 @@ namespace aux_ctrl
             shutting_down = true;
         }
 
+        // who to send the reply to, once its chain of reads is done. a request without payload is answered to every listener.
+        // to be called once the first read of the chain is queued, a request never read times out on its own
+        void remember_requester(replies::en reply, u32 len)
+        {
+            msg::payload::request requester = { 0, msg::src::none };
+            if (len)
+                requester = current_payload<msg::payload::request>(len);
+            requesters[reply].write(&requester); // when full, the reply to this one goes to every listener
+        }
+
+        // to the oldest requester still awaiting : the ones whose request timed out meanwhile, their chain of reads having been lost along
+        // the way, are skipped. with none left, to every listener
+        void send_reply(replies::en reply, msg::id::en reply_id, u16 len, u8* payload)
+        {
+            msg::payload::request requester = { 0, msg::src::none };
+            do
+            {
+                if (!requesters[reply].read_test(&requester))
+                {
+                    requester.correlation = 0;
+                    break;
+                }
+            } while (requester.correlation && !get_central().is_pending(requester.correlation));
+            get_central().reply(requester, reply_id, len, payload);
+        }
+
         void read_battery_level(u32 len)
         {
-            read_spi(AUX_CHRG_BATTLVL_REG);
+            if (read_spi(AUX_CHRG_BATTLVL_REG))
+                remember_requester(replies::battery_level, len);
         }
 
         void read_revision()
@@ -461,22 +494,26 @@ namespace aux_ctrl
 
         void read_serial_number(u32 len)
         {
-            read_spi(AUX_GPR_SERIAL_LOW_REG);
+            if (read_spi(AUX_GPR_SERIAL_LOW_REG))
+                remember_requester(replies::serial_number, len);
         }
 
         void read_battery_info(u32 len)
         {
-            read_spi(AUX_CHRG_BATTmAh_REG);
+            if (read_spi(AUX_CHRG_BATTmAh_REG))
+                remember_requester(replies::battery_info, len);
         }
 
         void read_charger_info(u32 len)
         {
-            read_spi(AUX_CHRG_OVRVCUMUL_REG);
+            if (read_spi(AUX_CHRG_OVRVCUMUL_REG))
+                remember_requester(replies::charger_info, len);
         }
 
         void read_auxctl_info(u32 len)
         {
-            read_spi(AUX_GPR_SYSCLK_LOW_REG);
+            if (read_spi(AUX_GPR_SYSCLK_LOW_REG))
+                remember_requester(replies::auxctl_info, len);
         }
 
         void clear_charger_faults(u32 len)
@@ -516,6 +553,17 @@ namespace aux_ctrl
             return (check_sum == verify);
         }
 
+    public:
+        typedef on<msg::id::timepulse, &link::time_pulse,
+                on<msg::id::shutdown, &link::shutdown,
+                on<msg::id::battery_level_request, &link::read_battery_level,
+                on<msg::id::serial_number_request, &link::read_serial_number,
+                on<msg::id::battery_info_request, &link::read_battery_info,
+                on<msg::id::charger_info_request, &link::read_charger_info,
+                on<msg::id::auxctl_info_request, &link::read_auxctl_info,
+                on<msg::id::clear_charger_faults, &link::clear_charger_faults> > > > > > > > observers;
+
+    private:
         static const CTL_EVENT_SET_t spi_idle = 1 << 0;
         static const CTL_EVENT_SET_t aux_message = 1 << 1;
         static const CTL_EVENT_SET_t messages_mask = 1 << 2;
@@ -536,6 +584,8 @@ namespace aux_ctrl
         msg::payload::battery_info battery_info_msg;
         msg::payload::charger_info charger_info_msg;
         msg::payload::auxctl_info auxctl_info_msg;
+
+        ring_buffer<msg::payload::request, 8> requesters[replies::count];
     };
 }
 
@@ -26,6 +26,18 @@ public:
         sys_snapshot = get_hw_clock().get_system_time();
     }
 
+    // the system time of the latest timepulse, in milliseconds. false before the first one
+    bool get_timepulse_millisec(u32& ms)
+    {
+        int enabled = ctl_global_interrupts_set(0); // the snapshot is written from the interrupt in two words
+            u64 snapshot = sys_snapshot;
+        ctl_global_interrupts_set(enabled);
+        if (!snapshot)
+            return false;
+        ms = get_hw_clock().system_to_millisec(snapshot);
+        return true;
+    }
+
     void set_real_time(const timedate& time, const double& tow)
     {
         ctl_mutex_lock(&mutex, CTL_TIMEOUT_INFINITE, 0);
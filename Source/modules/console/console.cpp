@@ -10,6 +10,7 @@
 #include "modules/debug/debug_io.hpp"
 #include "modules/file_system/file_system.hpp"
 #include "modules/file_system/file_system_queue.hpp"
+#include "modules/time_queue/time_queue.hpp"
 #include "modules/clock/rt_clock.hpp"
 #include "dev/sd_lpc3230.hpp"
 #include "modules/profiling/profiler.hpp"
@@ -51,10 +52,6 @@ void simple::init()
 {
     get_central().set_event(msg::src::console, &console_event, messages_mask);
 
-    set_method_observer(msg::id::battery_level, &simple::battery_level_event);
-    set_method_observer(msg::id::timeout, &simple::timeout_event);
-
-    subscribe_to_global_message(msg::id::battery_level);
 }
 
 void simple::get_and_init_event(CTL_EVENT_SET_t*& event_get, CTL_EVENT_SET_t& receive_mask_get)
@@ -234,6 +231,9 @@ void report_revision();
 #if ENABLE_FS_STATS
     void report_fs_stats();
 #endif
+#if ENABLE_MESSAGE_STATS
+    void report_message_stats();
+#endif
 void report_gps_time();
 #if ENABLE_ROVER_PROCESSOR
     void report_rover();
@@ -262,6 +262,15 @@ command_states::en simple::process_command_line(char* string, u32 len)
     {
         profile::controller::report();
     }
+    #if defined(CTL_PROFILING) && ENABLE_PROFILE_TRACE
+        else if (strncmp(string, "ptrace", len) == 0)
+        {
+            if (profile::controller::dump_trace("profile.trc"))
+                debug::printf("profiler trace written to profile.trc\r\n");
+            else
+                debug::printf("profiler trace could not be written\r\n");
+        }
+    #endif
     #ifdef TRACING
         else if (strncmp(string, "trace", len) == 0)
         {
@@ -280,15 +289,21 @@ command_states::en simple::process_command_line(char* string, u32 len)
             report_fs_stats();
         }
     #endif
+    #if ENABLE_MESSAGE_STATS
+        else if (strncmp(string, "msg", len) == 0)
+        {
+            report_message_stats();
+        }
+    #endif
     else if (strncmp(string, "time", len) == 0)
     {
         report_gps_time();
     }
     else if (strncmp(string, "batt", len) == 0)
     {
-        get_central().send_message(msg::src::aux, msg::id::battery_level_request);
+        if (!get_central().request(msg::src::aux, msg::id::battery_level_request, msg::src::console, 100))
+            return command_states::idle;
         set_awaited_event(msg::id::battery_level);
-        timeout = ctl_get_ticks_per_second() / 10;
         return command_states::await_result;
     }
     #if ENABLE_ROVER_PROCESSOR
@@ -393,20 +408,18 @@ void simple::battery_level_event(u32 len)
     }
 #endif
 
-void simple::timeout_event(u32 len)
+void simple::request_timeout_event(u32 len)
 {
     if (msg::id::none != awaited_event)
     {
         awaited_event = msg::id::none;
         debug::printf("timeout...\r\n");
         print_command_line();
-        #if ENABLE_UART_STATS
-            timeout = min_t(repeat_period, update_period);
-        #else
-            timeout = repeat_period;
-        #endif
     }
+}
 
+void simple::timeout_event(u32 len)
+{
     if (repeat_period)
     {
         if (ctl_current_time > last_repeat_time + repeat_period)
@@ -528,8 +541,19 @@ void report_revision()
         debug::printf("Cache Accesses    %d\r\n", stats.cache_accesses);
         debug::printf("Cache Hits        %d\r\n", stats.cache_hits);
         debug::printf("Cache Misses      %d\r\n", stats.cache_misses);
+        debug::printf("Cache Hit Rate    %d%%\r\n", stats.cache_hit_rate);
+        debug::printf("Cache Lookup (ns) %d\r\n", stats.cache_lookup_ns);
+        debug::printf("Cache Write-backs %d\r\n", stats.cache_write_backs);
         debug::printf("Write Rate (B/s)  %d\r\n", stats.write_bytes_per_sec);
         debug::printf("Read  Rate (B/s)  %d\r\n", stats.read_bytes_per_sec);
+        #if ENABLE_FS_FREE_MAP
+            debug::printf("Free clusters     %d\r\n", stats.free_clusters);
+        #endif
+        #if ENABLE_FS_FAT_CACHE
+            debug::printf("FAT Cache Hits    %d\r\n", stats.fat_cache_hits);
+            debug::printf("FAT Cache Misses  %d\r\n", stats.fat_cache_misses);
+            debug::printf("FAT Cache Flushes %d\r\n", stats.fat_cache_flushes);
+        #endif
 
         #if ENABLE_FS_QUEUE
             u32 free_block_count, queued_block_count, worked_on_block_count;
@@ -541,6 +565,70 @@ void report_revision()
     }
 #endif
 
+#if ENABLE_MESSAGE_STATS
+    static const char* message_source_names[] = { "main", "aux", "fs_queue", "time_queue", "gps_processor", "console" };
+    BOOST_STATIC_ASSERT(sizeof(message_source_names) / sizeof(const char*) == msg::src::none);
+
+    static const char* message_id_names[] = { "shutdown_request", "shutdown", "timepulse", "battery_level_request", "serial_number_request",
+                                              "battery_info_request", "charger_info_request", "auxctl_info_request", "clear_charger_faults",
+                                              "write_block_queued", "enqueue_time_event", "kill_time_event", "proximity_detected", "zigbee_not_cts",
+                                              "battery_level", "file_system_write_queue_full", "file_system_no_more_free", "serial_number",
+                                              "battery_info", "charger_info", "auxctl_info", "message_overflow", "request_timeout", "reply", "timeout",
+                                              "request_to_end_task" };
+    BOOST_STATIC_ASSERT(sizeof(message_id_names) / sizeof(const char*) == msg::id::none);
+
+    void report_latency(const async::latency_histogram& latency)
+    {
+        us mean = latency.count ? latency.total_us / latency.count : 0;
+        debug::printf("  %d messages, latency mean %llu us, max %d us\r\n", latency.count, mean, latency.max_us);
+        if (!latency.count)
+            return;
+        debug::printf(" ");
+        for (u32 b = 0; b < async::latency_histogram::bucket_count; ++b)
+        {
+            if (!latency.buckets[b])
+                continue;
+            if (b < async::latency_histogram::bucket_count - 1)
+                debug::printf(" <%dus:%d", 1 << b, latency.buckets[b]);
+            else
+                debug::printf(" more:%d", latency.buckets[b]);
+        }
+        debug::printf("\r\n");
+    }
+
+    void report_message_stats()
+    {
+        debug::printf("Message queues (bytes : high-water/size, drops)\r\n");
+        for (u32 q = 0; q < msg::src::none; ++q)
+        {
+            const async::message_queue::statistics* stats = get_central().get_queue_stats(static_cast<msg::src::en>(q));
+            if (!stats)
+                continue;
+            debug::printf("%s : tasks %d/%d %d, interrupts %d/%d %d, coalesced %d\r\n", message_source_names[q],
+                          stats->task_high_water, stats->task_size, stats->task_drops,
+                          stats->int_high_water, stats->int_size, stats->int_drops, stats->coalesced);
+            report_latency(stats->latency);
+        }
+
+        async::payload_slab& slab = get_central().get_shared_payloads();
+        debug::printf("Shared payloads : %d/%d slots at most, %d times none left\r\n", slab.get_high_water(), slab.get_slot_count(), slab.get_exhausted());
+
+        async::handle_pool<msg::max_time_events>& time_events = get_central().get_time_events();
+        debug::printf("Time events : %d scheduled, %d/%d at most, %d times none left, %d sent in %d wake ups\r\n", time_events.get_in_use(),
+                      time_events.get_high_water(), msg::max_time_events, time_events.get_exhausted(), get_time_queue().get_sent(), get_time_queue().get_wakeups());
+
+        debug::printf("Messages\r\n");
+        for (u32 id = 0; id < msg::id::none; ++id)
+        {
+            const async::latency_histogram& latency = get_central().get_id_latency(static_cast<msg::id::en>(id));
+            if (!latency.count)
+                continue;
+            debug::printf("%s\r\n", message_id_names[id]);
+            report_latency(latency);
+        }
+    }
+#endif
+
 #if ENABLE_UART_STATS
     void simple::report_uart_stats()
     {
@@ -698,6 +786,9 @@ void help()
     debug::printf("help : this message. this console sucks. about as flexible as a ton of rocks.\r\n");
     debug::printf("rev : revision information.\r\n");
     debug::printf("prof : profiler\r\n");
+    #if defined(CTL_PROFILING) && ENABLE_PROFILE_TRACE
+        debug::printf("ptrace : write the profiler event trace to profile.trc, in the session directory\r\n");
+    #endif
     #ifdef TRACING
         debug::printf("trace : tracing information\r\n");
     #endif
@@ -707,6 +798,9 @@ void help()
     #if ENABLE_FS_STATS
         debug::printf("fs : file system statistics\r\n");
     #endif
+    #if ENABLE_MESSAGE_STATS
+        debug::printf("msg : message queues occupancy, drops and latencies\r\n");
+    #endif
     debug::printf("time : current real time\r\n");
     debug::printf("batt : battery level\r\n");
     #if ENABLE_ROVER_PROCESSOR
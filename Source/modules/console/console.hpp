@@ -27,7 +27,7 @@ namespace command_states
     };
 }
 
-class simple : public base_sink<simple, msg::src::console, 4>
+class simple : public base_sink<simple, msg::src::console>
 {
 public:
     simple();
@@ -56,8 +56,16 @@ private:
     void await_message(u32 timeout);
     void set_awaited_event(msg::id::en ev);
     void battery_level_event(u32 len);
+    void request_timeout_event(u32 len);
     void timeout_event(u32 len);
 
+public:
+    typedef on<msg::id::battery_level, &simple::battery_level_event,
+            on<msg::id::request_timeout, &simple::request_timeout_event,
+            on<msg::id::timeout, &simple::timeout_event> > > observers;
+
+private:
+
     parse_states::en parse_state;
     static const u32 command_line_len = 128;
     char command_line[command_line_len];
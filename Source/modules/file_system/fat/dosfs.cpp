@@ -108,6 +108,8 @@ uint32_t DFS_GetVolInfo(uint8_t unit, uint8_t *scratchsector, uint32_t startsect
 	PLBR lbr = (PLBR) scratchsector;
 	volinfo->unit = unit;
 	volinfo->startsector = startsector;
+	volinfo->freemap = 0; // JR : the free cluster map must be rebuilt for this volume
+	volinfo->hintcluster = 0; // JR : so must the directory hint
 
 	if(DFS_ReadSector(unit,scratchsector,startsector,1))
 		return DFS_ERRMISC;
@@ -190,6 +192,75 @@ uint32_t DFS_GetVolInfo(uint8_t unit, uint8_t *scratchsector, uint32_t startsect
 	return DFS_OK;
 }
 
+/*
+	INTERNAL (JR addition)
+	Set or clear the bit of a cluster in the free cluster map, and track the free count
+*/
+static void DFS_MarkCluster(PVOLINFO volinfo, uint32_t cluster, uint8_t used)
+{
+	if (cluster < 2 || cluster >= volinfo->numclusters + 2)
+		return;
+
+	uint32_t *word = &volinfo->freemap[cluster >> 5];
+	uint32_t bit = 1u << (cluster & 31);
+
+	if (used && !(*word & bit)) {
+		*word |= bit;
+		volinfo->freecount--;
+	}
+	else if (!used && (*word & bit)) {
+		*word &= ~bit;
+		volinfo->freecount++;
+	}
+}
+
+/*
+	INTERNAL (JR addition)
+	Write a sector holding directory entries. The FAT goes out first, so that an entry never reaches
+	the media before the cluster chain it refers to, whatever the platform holds back in its caches
+*/
+static uint32_t DFS_WriteDirSector(PVOLINFO volinfo, uint8_t *scratch, uint32_t sector)
+{
+	if (DFS_FlushFAT(volinfo->unit))
+		return DFS_ERRMISC;
+	return DFS_WriteSector(volinfo->unit, scratch, sector, 1);
+}
+
+/*
+	INTERNAL (JR addition)
+	Nonzero if a FAT entry does not link to a further cluster : end of chain, bad cluster or read error
+*/
+static uint8_t DFS_IsChainEnd(PVOLINFO volinfo, uint32_t cluster)
+{
+	return cluster < 2 ||
+	  (volinfo->filesystem == FAT12 && cluster >= 0x0ff7) ||
+	  (volinfo->filesystem == FAT16 && cluster >= 0xfff7) ||
+	  (volinfo->filesystem == FAT32 && cluster >= 0x0ffffff7);
+}
+
+/*
+	INTERNAL (JR addition)
+	End of chain marker for the filesystem of a volume
+*/
+static uint32_t DFS_ChainEndMark(PVOLINFO volinfo)
+{
+	switch(volinfo->filesystem) {
+		case FAT12:		return 0xff8;
+		case FAT16:		return 0xfff8;
+		default:		return 0x0ffffff8;
+	}
+}
+
+/*
+	INTERNAL (JR addition)
+	Nonzero if the current cluster of a file is part of its contiguous reservation
+*/
+static uint8_t DFS_InReservation(PFILEINFO fileinfo)
+{
+	return fileinfo->reservedend &&
+	  fileinfo->cluster >= fileinfo->reservedstart && fileinfo->cluster <= fileinfo->reservedend;
+}
+
 /*
 	Fetch FAT entry for specified cluster number
 	You must provide a scratch buffer for one sector (SECTOR_SIZE) and a populated VOLINFO
@@ -435,6 +506,10 @@ uint32_t DFS_SetFAT(PVOLINFO volinfo, uint8_t *scratch, uint32_t *scratchcache,
 	else
 		result = DFS_ERRMISC;
 
+	// JR : keep the free cluster map in sync with what actually made it to the FAT
+	if (DFS_OK == result && volinfo->freemap)
+		DFS_MarkCluster(volinfo, cluster, new_contents != 0);
+
 	return result;
 }
 
@@ -477,6 +552,26 @@ uint8_t *DFS_CanonicalToDir(uint8_t *dest, uint8_t *src)
 uint32_t DFS_GetFreeFAT(PVOLINFO volinfo, uint8_t *scratch)
 {
 	uint32_t i, result = 0xffffffff, scratchcache = 0;
+
+	// JR : with a free cluster map, do a next-fit search over the bitmap instead of reading the FAT
+	if (volinfo->freemap) {
+		uint32_t words = DFS_FreeMapWords(volinfo);
+		uint32_t w = volinfo->nextfree >> 5;
+		// one extra iteration revisits the starting word, whose bits below the cursor were masked on the first pass
+		for (i = 0; i <= words; i++, w++) {
+			if (w >= words)
+				w = 0;
+			uint32_t bits = volinfo->freemap[w];
+			if (0 == i)
+				bits |= (1u << (volinfo->nextfree & 31)) - 1;
+			if (bits != 0xffffffff) {
+				result = (w << 5) + __builtin_ctz(~bits);
+				volinfo->nextfree = result; // the caller's DFS_SetFAT will mark it used
+				return result;
+			}
+		}
+		return 0x0ffffff7;		// Can't find a free cluster
+	}
 	
 	// Search starts at cluster 2, which is the first usable cluster
 	// NOTE: This search can't terminate at a bad cluster, because there might
@@ -490,6 +585,8 @@ uint32_t DFS_GetFreeFAT(PVOLINFO volinfo, uint8_t *scratch)
 	return 0x0ffffff7;		// Can't find a free cluster
 }
 
+static uint32_t DFS_NextFreeDirEnt(PVOLINFO volinfo, PDIRINFO di, PDIRENT de);
+
 /*
 	INTERNAL
 	Find a free directory entry in the directory specified by path
@@ -502,11 +599,21 @@ uint32_t DFS_GetFreeFAT(PVOLINFO volinfo, uint8_t *scratch)
 */
 uint32_t DFS_GetFreeDirEnt(PVOLINFO volinfo, uint8_t *path, PDIRINFO di, PDIRENT de)
 {
-	uint32_t tempclus,i;
-
 	if (DFS_OpenDir(volinfo, path, DFS_ACCESS, di))
 		return DFS_NOTFOUND;
 
+	return DFS_NextFreeDirEnt(volinfo, di, de);
+}
+
+/*
+	INTERNAL (JR addition)
+	Search an opened directory for an empty entry, from its current position on. The directory
+	is extended by a cluster if none is left. On success, di->currententry - 1 is the free entry.
+*/
+static uint32_t DFS_NextFreeDirEnt(PVOLINFO volinfo, PDIRINFO di, PDIRENT de)
+{
+	uint32_t tempclus,i;
+
 	// Set "search for empty" flag so DFS_GetNext knows what we're doing
 	di->flags |= DFS_DI_BLANKENT;
 
@@ -553,6 +660,7 @@ uint32_t DFS_GetFreeDirEnt(PVOLINFO volinfo, uint8_t *path, PDIRINFO di, PDIRENT
 				default:		return DFS_ERRMISC;
 			}
 			DFS_SetFAT(volinfo, di->scratch, &i, di->currentcluster, tempclus);
+			return DFS_OK; // JR : the first entry of the new cluster is free. this used to fall through to the error below
 		}
 	} while (!tempclus);
 
@@ -560,6 +668,112 @@ uint32_t DFS_GetFreeDirEnt(PVOLINFO volinfo, uint8_t *path, PDIRINFO di, PDIRENT
 	return DFS_ERRMISC;
 }
 
+/*
+	INTERNAL (JR addition)
+	Physical sector currently held by an opened directory
+*/
+static uint32_t DFS_DirSector(PVOLINFO volinfo, PDIRINFO dirinfo)
+{
+	if (dirinfo->currentcluster == 0) // FAT12/16 root directory
+		return volinfo->rootdir + dirinfo->currentsector;
+	return volinfo->dataarea + ((dirinfo->currentcluster - 2) * volinfo->secperclus) + dirinfo->currentsector;
+}
+
+/*
+	INTERNAL (JR addition)
+	Create a directory named dirname (8.3 directory entry form) in the free entry
+	dirinfo->currententry - 1, as left by DFS_NextFreeDirEnt. Its first cluster is returned
+	in *cluster. The position of dirinfo is kept, its scratch sector is not.
+*/
+static uint32_t DFS_NewDir(PVOLINFO volinfo, PDIRINFO dirinfo, uint8_t *dirname, uint32_t *cluster)
+{
+	DIRENT de;
+	uint32_t temp;
+	uint16_t year;
+	uint8_t month, day, hour, minute;
+	uint16_t tenths_of_sec;
+	uint8_t time_valid, date_low, date_high, time_low, time_high;
+
+	// put sane values in the directory entry
+	memset(&de, 0, sizeof(de));
+	memcpy(de.name, dirname, 11);
+
+	time_valid = DFS_GetTime(&year, &month, &day, &hour, &minute, &tenths_of_sec);
+	date_low = Private_GetDateLow(year, month, day, time_valid);
+	date_high = Private_GetDateHigh(year, month, day, time_valid);
+	time_low = Private_GetTimeLow(hour, minute, tenths_of_sec, time_valid);
+	time_high = Private_GetTimeHigh(hour, minute, tenths_of_sec, time_valid);
+
+	de.crttime_l = time_low;
+	de.crttime_h = time_high;
+	de.crtdate_l = date_low;
+	de.crtdate_h = date_high;
+	de.lstaccdate_l = date_low;
+	de.lstaccdate_h = date_high;
+	de.wrttime_l = time_low;
+	de.wrttime_h = time_high;
+	de.wrtdate_l = date_low;
+	de.wrtdate_h = date_high;
+
+	de.reserved = 0x08; // always created lower-case filenames, they look less aggressive
+	de.attr = ATTR_DIRECTORY;
+
+	// allocate a starting cluster for the directory entry
+	*cluster = DFS_GetFreeFAT(volinfo, dirinfo->scratch);
+	if (*cluster == 0x0ffffff7)
+		return DFS_ERRMISC;
+
+	de.startclus_l_l = *cluster & 0xff;
+	de.startclus_l_h = (*cluster & 0xff00) >> 8;
+	de.startclus_h_l = (*cluster & 0xff0000) >> 16;
+	de.startclus_h_h = (*cluster & 0xff000000) >> 24;
+
+	// clear the new cluster
+	memset(dirinfo->scratch, 0, SECTOR_SIZE);
+	if (DFS_WriteSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((*cluster - 2) * volinfo->secperclus), 1))
+		return DFS_ERRMISC;
+
+	// Mark newly allocated cluster as end of chain
+	// JR : before the directory entry refers to it
+	temp = 0;
+	DFS_SetFAT(volinfo, dirinfo->scratch, &temp, *cluster, DFS_ChainEndMark(volinfo));
+
+	// write the directory entry
+	// note that we no longer have the sector containing the directory entry,
+	// tragically, so we have to re-read it
+	if (DFS_ReadSector(volinfo->unit, dirinfo->scratch, DFS_DirSector(volinfo, dirinfo), 1))
+		return DFS_ERRMISC;
+	memcpy(&(((PDIRENT) dirinfo->scratch)[dirinfo->currententry-1]), &de, sizeof(DIRENT));
+	if (DFS_WriteDirSector(volinfo, dirinfo->scratch, DFS_DirSector(volinfo, dirinfo)))
+		return DFS_ERRMISC;
+	return DFS_OK;
+}
+
+/*
+	INTERNAL (JR addition)
+	Nonzero if a path names the hinted directory of the root, see DFS_SetDirHint
+*/
+static uint8_t DFS_IsHintedDir(PVOLINFO volinfo, uint8_t *dirname)
+{
+	uint8_t tmpfn[12];
+
+	if (!volinfo->hintcluster)
+		return 0;
+
+	while (*dirname == DIR_SEPARATOR)
+		dirname++;
+	DFS_CanonicalToDir(tmpfn, dirname);
+	if (memcmp(tmpfn, volinfo->hintname, 11))
+		return 0;
+
+	// only a single path component, possibly followed by a separator
+	while (*dirname && *dirname != DIR_SEPARATOR)
+		dirname++;
+	if (*dirname == DIR_SEPARATOR)
+		dirname++;
+	return !*dirname;
+}
+
 /*
 	Open a directory for enumeration by DFS_GetNextDirEnt
 	You must supply a populated VOLINFO (see DFS_GetVolInfo)
@@ -569,11 +783,6 @@ uint32_t DFS_GetFreeDirEnt(PVOLINFO volinfo, uint8_t *path, PDIRINFO di, PDIRENT
 */
 uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO dirinfo)
 {
-    uint16_t year;
-    uint8_t month, day, hour, minute;
-    uint16_t tenths_of_sec;
-    uint8_t time_valid, date_low, date_high, time_low, time_high;
-
 	// Default behavior is a regular search for existing entries
 	dirinfo->flags = 0;
 
@@ -596,6 +805,16 @@ uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO
 		}
 	}
 
+	// JR : the hinted directory is opened without scanning the root
+	else if (DFS_IsHintedDir(volinfo, dirname)) {
+		dirinfo->currentcluster = volinfo->hintcluster;
+		dirinfo->currentsector = 0;
+		dirinfo->currententry = 0;
+
+		// read first sector of directory
+		return DFS_ReadSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((dirinfo->currentcluster - 2) * volinfo->secperclus), 1);
+	}
+
 	// This is not the root directory. We need to find the start of this subdirectory.
 	// We do this by devious means, using our own companion function DFS_GetNext.
 	else {
@@ -662,7 +881,7 @@ uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO
 				return DFS_NOTFOUND;
             else if (mode & DFS_CREATE)
             {
-                uint32_t cluster, cluster_val, temp;
+                uint32_t cluster;
 
                 strncpy((char *) tmppath, (char *) dirname, MAX_PATH);
                 tmppath[MAX_PATH - 1] = 0;
@@ -688,63 +907,8 @@ uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO
                 if (DFS_OK != DFS_GetFreeDirEnt(volinfo, tmppath, dirinfo, &de))
                     return DFS_ERRMISC;
     
-                // put sane values in the directory entry
-                memset(&de, 0, sizeof(de));
-                memcpy(de.name, tmpfn, 11);
-
-                time_valid = DFS_GetTime(&year, &month, &day, &hour, &minute, &tenths_of_sec);
-                date_low = Private_GetDateLow(year, month, day, time_valid);
-                date_high = Private_GetDateHigh(year, month, day, time_valid);
-                time_low = Private_GetTimeLow(hour, minute, tenths_of_sec, time_valid);
-                time_high = Private_GetTimeHigh(hour, minute, tenths_of_sec, time_valid);
-                
-                de.crttime_l = time_low;
-                de.crttime_h = time_high;
-                de.crtdate_l = date_low;
-                de.crtdate_h = date_high;
-                de.lstaccdate_l = date_low;
-                de.lstaccdate_h = date_high;
-                de.wrttime_l = time_low;
-                de.wrttime_h = time_high;
-                de.wrtdate_l = date_low;
-                de.wrtdate_h = date_high;
-    
-                de.reserved = 0x08; // always created lower-case filenames, they look less aggressive
-                de.attr = ATTR_DIRECTORY;
-    
-                // allocate a starting cluster for the directory entry
-                cluster = DFS_GetFreeFAT(volinfo, dirinfo->scratch);
-    
-                de.startclus_l_l = cluster & 0xff;
-                de.startclus_l_h = (cluster & 0xff00) >> 8;
-                de.startclus_h_l = (cluster & 0xff0000) >> 16;
-                de.startclus_h_h = (cluster & 0xff000000) >> 24;
-
-                // clear the new cluster
-                if (DFS_ReadSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((cluster - 2) * volinfo->secperclus), 1))
-                    return DFS_ERRMISC;
-                memset(dirinfo->scratch, 0, SECTOR_SIZE);
-                if (DFS_WriteSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((cluster - 2) * volinfo->secperclus), 1))
-                    return DFS_ERRMISC;
-                
-                // write the directory entry
-                // note that we no longer have the sector containing the directory entry,
-                // tragically, so we have to re-read it
-                if (DFS_ReadSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((dirinfo->currentcluster - 2) * volinfo->secperclus) + dirinfo->currentsector, 1))
+                if (DFS_OK != DFS_NewDir(volinfo, dirinfo, tmpfn, &cluster))
                     return DFS_ERRMISC;
-                memcpy(&(((PDIRENT) dirinfo->scratch)[dirinfo->currententry-1]), &de, sizeof(DIRENT));
-                if (DFS_WriteSector(volinfo->unit, dirinfo->scratch, volinfo->dataarea + ((dirinfo->currentcluster - 2) * volinfo->secperclus) + dirinfo->currentsector, 1))
-                    return DFS_ERRMISC;
-        
-                // Mark newly allocated cluster as end of chain			
-                switch(volinfo->filesystem) {
-                    case FAT12:		cluster_val = 0xff8;	break;
-                    case FAT16:		cluster_val = 0xfff8;	break;
-                    case FAT32:		cluster_val = 0x0ffffff8;	break;
-                    default:		return DFS_ERRMISC;
-                }
-                temp = 0;
-                DFS_SetFAT(volinfo, dirinfo->scratch, &temp, cluster, cluster_val);
 
                 dirinfo->currentcluster = cluster;
                 dirinfo->currentsector = 0;
@@ -769,6 +933,29 @@ uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO
 	return DFS_OK;
 }
 
+/*
+	Create a directory in the first free entry from the current position of a directory
+*/
+uint32_t DFS_MakeDir(PVOLINFO volinfo, PDIRINFO dirinfo, uint8_t *dirname, uint32_t *cluster)
+{
+	uint8_t tmpfn[12];
+	DIRENT de;
+
+	DFS_CanonicalToDir(tmpfn, dirname);
+	if (DFS_OK != DFS_NextFreeDirEnt(volinfo, dirinfo, &de))
+		return DFS_ERRMISC;
+	return DFS_NewDir(volinfo, dirinfo, tmpfn, cluster);
+}
+
+/*
+	Remember where a directory of the root starts
+*/
+void DFS_SetDirHint(PVOLINFO volinfo, uint8_t *dirname, uint32_t cluster)
+{
+	DFS_CanonicalToDir(volinfo->hintname, dirname);
+	volinfo->hintcluster = cluster;
+}
+
 /*
 	Get next entry in opened directory structure. Copies fields into the dirent
 	structure, updates dirinfo. Note that it is the _caller's_ responsibility to
@@ -1010,16 +1197,8 @@ uint32_t DFS_OpenFile(PVOLINFO volinfo, uint8_t *path, uint8_t mode, uint8_t *sc
 		fileinfo->firstcluster = cluster;
 		fileinfo->filelen = 0;
 		
-		// write the directory entry
-		// note that we no longer have the sector containing the directory entry,
-		// tragically, so we have to re-read it
-		if (DFS_ReadSector(volinfo->unit, scratch, fileinfo->dirsector, 1))
-			return DFS_ERRMISC;
-		memcpy(&(((PDIRENT) scratch)[di.currententry-1]), &de, sizeof(DIRENT));
-		if (DFS_WriteSector(volinfo->unit, scratch, fileinfo->dirsector, 1))
-			return DFS_ERRMISC;
-
 		// Mark newly allocated cluster as end of chain			
+		// JR : before the directory entry refers to it
 		switch(volinfo->filesystem) {
 			case FAT12:		cluster = 0xff8;	break;
 			case FAT16:		cluster = 0xfff8;	break;
@@ -1029,6 +1208,15 @@ uint32_t DFS_OpenFile(PVOLINFO volinfo, uint8_t *path, uint8_t mode, uint8_t *sc
 		temp = 0;
 		DFS_SetFAT(volinfo, scratch, &temp, fileinfo->cluster, cluster);
 
+		// write the directory entry
+		// note that we no longer have the sector containing the directory entry,
+		// tragically, so we have to re-read it
+		if (DFS_ReadSector(volinfo->unit, scratch, fileinfo->dirsector, 1))
+			return DFS_ERRMISC;
+		memcpy(&(((PDIRENT) scratch)[di.currententry-1]), &de, sizeof(DIRENT));
+		if (DFS_WriteDirSector(volinfo, scratch, fileinfo->dirsector))
+			return DFS_ERRMISC;
+
         fileinfo->volinfo = volinfo; // only set this field when we are sure the file has been opened
 
 		return DFS_OK;
@@ -1050,6 +1238,14 @@ uint32_t DFS_ReadFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uin
 	uint32_t result = DFS_OK;
 	uint32_t sector;
 	uint32_t bytesread;
+	uint32_t sector_count;
+	uint32_t sectors_left;
+	uint32_t runclusters;
+	uint32_t nextcluster;
+	uint32_t fatcache;
+	uint32_t clusterbytes;
+
+	uint32_t max_consecutive_blocks = DFS_GetMaxReadBlockCount();
 
 	// Don't try to read past EOF
 	if (len > fileinfo->filelen - fileinfo->pointer)
@@ -1065,6 +1261,7 @@ uint32_t DFS_ReadFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uin
 		sector = fileinfo->volinfo->dataarea +
 		  ((fileinfo->cluster - 2) * fileinfo->volinfo->secperclus) +
 		  div(div(fileinfo->pointer,fileinfo->volinfo->secperclus * SECTOR_SIZE).rem, SECTOR_SIZE).quot;
+		runclusters = 0;
 
 		// Case 1 - File pointer is not on a sector boundary
 		if (div(fileinfo->pointer, SECTOR_SIZE).rem) {
@@ -1107,11 +1304,32 @@ uint32_t DFS_ReadFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uin
 			// pointer to a cluster boundary the first pass through, so all subsequent
 			// [large] read requests would be able to go a cluster at a time).
 			if (remain >= SECTOR_SIZE) {
-				result = DFS_ReadSector(fileinfo->volinfo->unit, buffer, sector, 1);
-				remain -= SECTOR_SIZE;
-				buffer += SECTOR_SIZE;
-				fileinfo->pointer += SECTOR_SIZE;
-				bytesread = SECTOR_SIZE;
+				// JR : read up to the end of the cluster in a single request, and keep going over the clusters
+				// that follow as long as the chain is contiguous, which is the common case on a card formatted
+				// and written by us (see DFS_ReserveFile). runclusters counts the clusters entered this way.
+				sector_count = remain / SECTOR_SIZE;
+				if (sector_count > max_consecutive_blocks)
+					sector_count = max_consecutive_blocks;
+				sectors_left = fileinfo->volinfo->secperclus -
+				  div(div(fileinfo->pointer,fileinfo->volinfo->secperclus * SECTOR_SIZE).rem, SECTOR_SIZE).quot;
+				fatcache = 0;
+				while (sector_count > sectors_left) {
+					if (DFS_InReservation(fileinfo) && fileinfo->cluster + runclusters < fileinfo->reservedend)
+						nextcluster = fileinfo->cluster + runclusters + 1;
+					else
+						nextcluster = DFS_GetFAT(fileinfo->volinfo, scratch, &fatcache, fileinfo->cluster + runclusters);
+					if (nextcluster != fileinfo->cluster + runclusters + 1)
+						break;
+					runclusters++;
+					sectors_left += fileinfo->volinfo->secperclus;
+				}
+				if (sector_count > sectors_left)
+					sector_count = sectors_left;
+				result = DFS_ReadSector(fileinfo->volinfo->unit, buffer, sector, sector_count);
+				remain -= SECTOR_SIZE * sector_count;
+				buffer += SECTOR_SIZE * sector_count;
+				fileinfo->pointer += SECTOR_SIZE * sector_count;
+				bytesread = SECTOR_SIZE * sector_count;
 			}
 			// Case 2B - We are only reading a partial sector
 			else {
@@ -1126,9 +1344,14 @@ uint32_t DFS_ReadFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uin
 
 		*successcount += bytesread;
 
+		// JR : the read went into every cluster of the contiguous run, they were already looked up above. it may
+		// also end exactly on the boundary of the last one, which is handled below like any other cluster change.
+		fileinfo->cluster += runclusters;
+
 		// check to see if we stepped over a cluster boundary
-		if (div(fileinfo->pointer - bytesread, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot !=
-		  div(fileinfo->pointer, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot) {
+		// JR : in uint32_t, div() would give an int quotient to compare with the unsigned run length
+		clusterbytes = fileinfo->volinfo->secperclus * SECTOR_SIZE;
+		if ((fileinfo->pointer - bytesread) / clusterbytes + runclusters != fileinfo->pointer / clusterbytes) {
 			// An act of minor evil - we use bytesread as a scratch integer, knowing that
 			// its value is not used after updating *successcount above
 			bytesread = 0;
@@ -1264,11 +1487,8 @@ uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, ui
 	uint32_t sector;
 	uint32_t byteswritten;
     uint32_t sector_count;
-
-    uint16_t year;
-    uint8_t month, day, hour, minute;
-    uint16_t tenths_of_sec;
-    uint8_t time_valid, date_low, date_high, time_low, time_high;
+    uint32_t sectors_left;
+    uint32_t clusters_crossed;
 
     uint32_t max_consecutive_blocks = DFS_GetMaxBlockCount();
 
@@ -1339,8 +1559,14 @@ uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, ui
 			if (remain >= SECTOR_SIZE)
             {
                 sector_count = remain / SECTOR_SIZE;
-                if (sector_count > fileinfo->volinfo->secperclus)
-                    sector_count = fileinfo->volinfo->secperclus;
+                // JR : never write past the end of the current cluster, unless the clusters that follow
+                // belong to a contiguous reservation (see DFS_ReserveFile)
+                sectors_left = fileinfo->volinfo->secperclus -
+                  div(div(fileinfo->pointer,fileinfo->volinfo->secperclus * SECTOR_SIZE).rem, SECTOR_SIZE).quot;
+                if (DFS_InReservation(fileinfo))
+                    sectors_left += (fileinfo->reservedend - fileinfo->cluster) * fileinfo->volinfo->secperclus;
+                if (sector_count > sectors_left)
+                    sector_count = sectors_left;
                 if (sector_count > max_consecutive_blocks)
                     sector_count = max_consecutive_blocks;
 				result = DFS_WriteSector(fileinfo->volinfo->unit, buffer, sector, sector_count); // JR : security concern : we are writing buffer directly, thus we also write the contents after buffer, which is private, or maybe even unaccessible, data
@@ -1381,9 +1607,17 @@ uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, ui
 
 		*successcount += byteswritten;
 
+		clusters_crossed = div(fileinfo->pointer, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot -
+		  div(fileinfo->pointer - byteswritten, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot;
+
+		// JR : inside a reservation, the clusters are contiguous and already linked : no need to read the FAT
+		while (clusters_crossed && DFS_InReservation(fileinfo) && fileinfo->cluster < fileinfo->reservedend) {
+			fileinfo->cluster++;
+			clusters_crossed--;
+		}
+
 		// check to see if we stepped over a cluster boundary
-		if (div(fileinfo->pointer - byteswritten, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot !=
-		  div(fileinfo->pointer, fileinfo->volinfo->secperclus * SECTOR_SIZE).quot) {
+		if (clusters_crossed) {
 		  	uint32_t lastcluster;
 
 		  	// We've transgressed into another cluster. If we were already at EOF,
@@ -1425,6 +1659,30 @@ uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, ui
 		}
 	}
 
+	// JR : the directory entry now holds a stale size. in lazy mode, leave it to DFS_UpdateDirEnt to
+	// write it back later, which saves a read-modify-write of the directory sector on every call
+	fileinfo->direntdirty = 1;
+	if (!(fileinfo->mode & DFS_LAZY_DIRENT)) {
+		if (DFS_UpdateDirEnt(fileinfo, scratch))
+			return DFS_ERRMISC;
+	}
+
+	return result;
+}
+
+/*
+	Write back the size and modification time of a file to its directory entry
+*/
+uint32_t DFS_UpdateDirEnt(PFILEINFO fileinfo, uint8_t *scratch)
+{
+    uint16_t year;
+    uint8_t month, day, hour, minute;
+    uint16_t tenths_of_sec;
+    uint8_t time_valid, date_low, date_high, time_low, time_high;
+
+    if (!fileinfo->direntdirty)
+        return DFS_OK;
+
     time_valid = DFS_GetTime(&year, &month, &day, &hour, &minute, &tenths_of_sec);
     date_low = Private_GetDateLow(year, month, day, time_valid);
     date_high = Private_GetDateHigh(year, month, day, time_valid);
@@ -1442,8 +1700,245 @@ uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, ui
     ((PDIRENT) scratch)[fileinfo->diroffset].wrttime_h = time_high;
     ((PDIRENT) scratch)[fileinfo->diroffset].wrtdate_l = date_low;
     ((PDIRENT) scratch)[fileinfo->diroffset].wrtdate_h = date_high;
-    if (DFS_WriteSector(fileinfo->volinfo->unit, scratch, fileinfo->dirsector, 1))
+    if (DFS_WriteDirSector(fileinfo->volinfo, scratch, fileinfo->dirsector))
         return DFS_ERRMISC;
 
-	return result;
+    fileinfo->direntdirty = 0;
+	return DFS_OK;
+}
+
+/*
+	Number of 32-bit words needed to hold the free cluster map of a volume
+	Clusters are numbered from 2 to numclusters + 1, entries 0 and 1 being reserved.
+*/
+uint32_t DFS_FreeMapWords(PVOLINFO volinfo)
+{
+	return (volinfo->numclusters + 2 + 31) >> 5;
+}
+
+/*
+	Build the in-RAM free cluster map of a volume
+*/
+uint32_t DFS_BuildFreeMap(PVOLINFO volinfo, uint8_t *scratch, uint32_t *map, uint32_t mapwords)
+{
+	uint32_t i, words, entry, scratchcache = 0;
+
+	volinfo->freemap = 0; // DFS_SetFAT must not touch the map while it is being built
+
+	if (!map)
+		return DFS_OK;
+
+	words = DFS_FreeMapWords(volinfo);
+	if (mapwords < words)
+		return DFS_ERRMISC;
+
+	// start with everything marked as used : reserved entries 0 and 1, and the padding past the last cluster
+	memset(map, 0xff, words * sizeof(uint32_t));
+	volinfo->freecount = 0;
+
+	for (i = 2; i < volinfo->numclusters + 2; i++) {
+		entry = DFS_GetFAT(volinfo, scratch, &scratchcache, i);
+		if (0 == scratchcache) // a FAT sector could not be read, the map would be unreliable
+			return DFS_ERRMISC;
+		if (!entry) {
+			map[i >> 5] &= ~(1u << (i & 31));
+			volinfo->freecount++;
+		}
+	}
+
+	volinfo->nextfree = 2;
+	volinfo->freemap = map;
+	return DFS_OK;
+}
+
+/*
+	INTERNAL (JR addition)
+	Write count consecutive FAT entries, starting at cluster first. If link is nonzero, each
+	entry points to the next cluster and the last one ends the chain, forming a contiguous
+	chain. Otherwise, all the entries are freed.
+	Unlike calling DFS_SetFAT for each entry, FAT16 and FAT32 entries sharing a FAT sector
+	are written with a single sector write.
+*/
+static uint32_t DFS_SetFATRun(PVOLINFO volinfo, uint8_t *scratch, uint32_t first, uint32_t count, uint8_t link)
+{
+	uint32_t cluster, sectorfirst, value, offset, sector, entrysize, scratchcache = 0;
+	uint32_t last = first + count - 1;
+
+	// FAT12 entries may straddle two sectors, keep it simple
+	if (volinfo->filesystem == FAT12) {
+		for (cluster = first; cluster <= last; cluster++) {
+			value = !link ? 0 : (cluster == last ? DFS_ChainEndMark(volinfo) : cluster + 1);
+			if (DFS_SetFAT(volinfo, scratch, &scratchcache, cluster, value))
+				return DFS_ERRMISC;
+		}
+		return DFS_OK;
+	}
+
+	entrysize = (volinfo->filesystem == FAT16) ? 2 : 4;
+	cluster = first;
+	while (cluster <= last) {
+		sector = volinfo->fat1 + (cluster * entrysize) / SECTOR_SIZE;
+		if (DFS_ReadSector(volinfo->unit, scratch, sector, 1))
+			return DFS_ERRMISC;
+
+		// fill all the entries of the run held by this sector
+		sectorfirst = cluster;
+		do {
+			value = !link ? 0 : (cluster == last ? DFS_ChainEndMark(volinfo) : cluster + 1);
+			offset = (cluster * entrysize) % SECTOR_SIZE;
+			scratch[offset] = value & 0xff;
+			scratch[offset+1] = (value & 0xff00) >> 8;
+			if (entrysize == 4) {
+				scratch[offset+2] = (value & 0xff0000) >> 16;
+				scratch[offset+3] = (scratch[offset+3] & 0xf0) | ((value & 0x0f000000) >> 24);
+			}
+			cluster++;
+		} while (cluster <= last && (cluster * entrysize) % SECTOR_SIZE);
+
+		if (DFS_WriteSector(volinfo->unit, scratch, sector, 1))
+			return DFS_ERRMISC;
+        #if !DISABLE_SECOND_FAT
+		// mirror the FAT into copy 2
+		if (DFS_WriteSector(volinfo->unit, scratch, sector + volinfo->secperfat, 1))
+			return DFS_ERRMISC;
+        #endif
+
+		if (volinfo->freemap) {
+			for (value = sectorfirst; value < cluster; value++)
+				DFS_MarkCluster(volinfo, value, link);
+		}
+	}
+	return DFS_OK;
+}
+
+/*
+	INTERNAL (JR addition)
+	Find the first run of count contiguous free clusters. Uses the free cluster map if
+	there is one, otherwise reads the FAT.
+	Returns FAT32 bad_sector (0x0ffffff7) if there is no such run
+*/
+static uint32_t DFS_FindFreeRun(PVOLINFO volinfo, uint8_t *scratch, uint32_t count)
+{
+	uint32_t cluster, runstart = 0, runlen = 0, scratchcache = 0;
+	uint8_t isfree;
+
+	for (cluster = 2; cluster < volinfo->numclusters + 2; cluster++) {
+		if (volinfo->freemap) {
+			// skip fully used words in one step
+			if (!(cluster & 31) && volinfo->freemap[cluster >> 5] == 0xffffffff) {
+				cluster += 31;
+				runlen = 0;
+				continue;
+			}
+			isfree = !(volinfo->freemap[cluster >> 5] & (1u << (cluster & 31)));
+		}
+		else
+			isfree = !DFS_GetFAT(volinfo, scratch, &scratchcache, cluster);
+
+		if (!isfree) {
+			runlen = 0;
+			continue;
+		}
+		if (!runlen)
+			runstart = cluster;
+		if (++runlen == count)
+			return runstart;
+	}
+	return 0x0ffffff7;
+}
+
+/*
+	INTERNAL (JR addition)
+	Free a cluster chain, starting at cluster. Contiguous parts of the chain are freed
+	with DFS_SetFATRun.
+*/
+static uint32_t DFS_FreeChain(PVOLINFO volinfo, uint8_t *scratch, uint32_t cluster)
+{
+	uint32_t runstart, runlen, next, scratchcache;
+
+	while (!DFS_IsChainEnd(volinfo, cluster)) {
+		runstart = cluster;
+		runlen = 1;
+		scratchcache = 0;
+		while ((next = DFS_GetFAT(volinfo, scratch, &scratchcache, cluster)) == cluster + 1) {
+			cluster = next;
+			runlen++;
+		}
+		if (!scratchcache)
+			return DFS_ERRMISC;
+		if (DFS_SetFATRun(volinfo, scratch, runstart, runlen, 0))
+			return DFS_ERRMISC;
+		cluster = next;
+	}
+	return DFS_OK;
+}
+
+/*
+	Reserve contiguous clusters at the end of an open file
+*/
+uint32_t DFS_ReserveFile(PFILEINFO fileinfo, uint8_t *scratch, uint32_t clusters)
+{
+	PVOLINFO volinfo = fileinfo->volinfo;
+	uint32_t last, next, run, scratchcache = 0;
+
+	if (!(fileinfo->mode & DFS_WRITE) || !clusters || fileinfo->reservedend)
+		return DFS_ERRMISC;
+
+	// find the last cluster of the chain
+	last = fileinfo->cluster;
+	while (!DFS_IsChainEnd(volinfo, next = DFS_GetFAT(volinfo, scratch, &scratchcache, last)))
+		last = next;
+	if (!scratchcache)
+		return DFS_ERRMISC;
+
+	run = DFS_FindFreeRun(volinfo, scratch, clusters);
+	if (run == 0x0ffffff7)
+		return DFS_ERRMISC;
+
+	// build the chain before linking it to the file, so an interruption only loses clusters
+	if (DFS_SetFATRun(volinfo, scratch, run, clusters, 1))
+		return DFS_ERRMISC;
+	scratchcache = 0;
+	if (DFS_SetFAT(volinfo, scratch, &scratchcache, last, run)) {
+		DFS_SetFATRun(volinfo, scratch, run, clusters, 0);
+		return DFS_ERRMISC;
+	}
+
+	fileinfo->reservedstart = run;
+	fileinfo->reservedend = run + clusters - 1;
+	return DFS_OK;
+}
+
+/*
+	Release the clusters reserved past the end of a file
+*/
+uint32_t DFS_TrimFile(PFILEINFO fileinfo, uint8_t *scratch)
+{
+	PVOLINFO volinfo = fileinfo->volinfo;
+	uint32_t keep, next, i, scratchcache = 0;
+
+	if (!fileinfo->reservedend)
+		return DFS_OK;
+	fileinfo->reservedstart = 0;
+	fileinfo->reservedend = 0;
+
+	// find the cluster holding the end of the file. files being logged are written at their end,
+	// in which case it is the current cluster.
+	if (fileinfo->pointer == fileinfo->filelen)
+		keep = fileinfo->cluster;
+	else {
+		keep = fileinfo->firstcluster;
+		for (i = fileinfo->filelen ? (fileinfo->filelen - 1) / (volinfo->secperclus * SECTOR_SIZE) : 0; i; i--)
+			keep = DFS_GetFAT(volinfo, scratch, &scratchcache, keep);
+		if (DFS_IsChainEnd(volinfo, keep))
+			return DFS_ERRMISC;
+	}
+
+	next = DFS_GetFAT(volinfo, scratch, &scratchcache, keep);
+	if (DFS_IsChainEnd(volinfo, next))
+		return DFS_OK;
+
+	if (DFS_SetFAT(volinfo, scratch, &scratchcache, keep, DFS_ChainEndMark(volinfo)))
+		return DFS_ERRMISC;
+	return DFS_FreeChain(volinfo, scratch, next);
 }
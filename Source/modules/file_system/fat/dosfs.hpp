@@ -12,8 +12,10 @@
 // User-supplied functions
 uint32_t DFS_ReadSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t count);
 uint32_t DFS_WriteSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t count);
+uint32_t DFS_FlushFAT(uint8_t unit); // JR : writes out any FAT sector held back by the platform, 0 on success. see DFS_WriteDirSector
 uint8_t DFS_GetTime(uint16_t* year, uint8_t* month, uint8_t* day, uint8_t* hour, uint8_t* minutes, uint16_t* tenths_of_sec);
 uint32_t DFS_GetMaxBlockCount();
+uint32_t DFS_GetMaxReadBlockCount();
 
 //===================================================================
 // Configurable items
@@ -39,6 +41,7 @@ uint32_t DFS_GetMaxBlockCount();
 #define DFS_READ		1			// read-only
 #define DFS_WRITE		2			// write-only
 #define DFS_WRITE_DIRS  4           // create needed directories if possible while opening
+#define DFS_LAZY_DIRENT 8           // do not update the directory entry on every write, see DFS_UpdateDirEnt
                                     // file in write mode
 
 //===================================================================
@@ -262,6 +265,15 @@ typedef struct _tagVOLINFO {
 	uint32_t fat1;				// starting sector# of FAT copy 1
 	uint32_t rootdir;			// starting sector# of root directory (FAT12/FAT16) or cluster (FAT32)
 	uint32_t dataarea;			// starting sector# of data area (cluster #2)
+
+	// JR : optional in-RAM free cluster map, see DFS_BuildFreeMap
+	uint32_t *freemap;			// one bit per cluster, set when the cluster is in use. 0 when no map is built
+	uint32_t freecount;			// number of free clusters, valid only while freemap is set
+	uint32_t nextfree;			// next-fit cursor : cluster at which the next free cluster search starts
+
+	// JR : a directory of the root reached without scanning it, see DFS_SetDirHint
+	uint8_t hintname[12];		// its name, in directory entry form
+	uint32_t hintcluster;		// its first cluster, 0 when there is no hint
 } VOLINFO, *PVOLINFO;
 
 /*
@@ -293,6 +305,9 @@ typedef struct _tagFILEINFO {
 
 	uint32_t cluster;			// current cluster
 	uint32_t pointer;			// current (BYTE) pointer
+	uint8_t direntdirty;		// JR : size in the directory entry is out of date (see DFS_LAZY_DIRENT)
+	uint32_t reservedstart;		// JR : first cluster of the contiguous reservation, see DFS_ReserveFile
+	uint32_t reservedend;		// JR : last cluster of the contiguous reservation, 0 if none
 } FILEINFO, *PFILEINFO;
 
 /*
@@ -336,6 +351,23 @@ uint32_t DFS_OpenDir(PVOLINFO volinfo, uint8_t *dirname, uint8_t mode, PDIRINFO
 */
 uint32_t DFS_GetNext(PVOLINFO volinfo, PDIRINFO dirinfo, PDIRENT dirent);
 
+/*
+	Create a directory in an opened directory (JR addition)
+	The directory goes to the first free entry from the current position of dirinfo on, so
+	a caller knowing where the last entry lies does not scan the whole parent directory.
+	No lookup is made : the caller ensures the name is not already taken.
+	On success, dirinfo->currentcluster and currentsector locate the sector holding the new
+	entry, currententry - 1 is its index within it, and its first cluster is in *cluster.
+*/
+uint32_t DFS_MakeDir(PVOLINFO volinfo, PDIRINFO dirinfo, uint8_t *dirname, uint32_t *cluster);
+
+/*
+	Remember where a directory of the root starts (JR addition)
+	DFS_OpenDir, and thus DFS_OpenFile, then reach that directory without scanning the root.
+	A cluster of 0 clears the hint.
+*/
+void DFS_SetDirHint(PVOLINFO volinfo, uint8_t *dirname, uint32_t cluster);
+
 /*
 	Open a file for reading or writing. You supply populated VOLINFO, a path to the file,
 	mode (DFS_READ or DFS_WRITE) and an empty fileinfo structure. You also need to
@@ -362,6 +394,15 @@ uint32_t DFS_ReadFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uin
 */
 uint32_t DFS_WriteFile(PFILEINFO fileinfo, uint8_t *scratch, uint8_t *buffer, uint32_t *successcount, uint32_t len);
 
+/*
+	Write back the size and modification time of an open file to its directory entry (JR addition)
+	DFS_WriteFile does this by itself on every call, unless the file was opened with
+	DFS_LAZY_DIRENT. In that case, the caller decides when the directory sector is
+	updated, e.g. on flush and close. Does nothing if the entry is already up to date.
+	Requires a SECTOR_SIZE scratch buffer
+*/
+uint32_t DFS_UpdateDirEnt(PFILEINFO fileinfo, uint8_t *scratch);
+
 /*
 	Seek file pointer to a given position
 	This function does not return status - refer to the fileinfo->pointer value
@@ -376,6 +417,50 @@ void DFS_Seek(PFILEINFO fileinfo, uint32_t offset, uint8_t *scratch);
 */
 uint32_t DFS_UnlinkFile(PVOLINFO volinfo, uint8_t *path, uint8_t *scratch);
 
+/*
+	Find the first unused FAT entry (next-fit over the free cluster map, if one is built)
+	You must provide a scratch buffer for one sector (SECTOR_SIZE) and a populated VOLINFO
+	Returns FAT32 bad_sector (0x0ffffff7) if there is no free cluster available
+*/
+uint32_t DFS_GetFreeFAT(PVOLINFO volinfo, uint8_t *scratch);
+
+/*
+	Reserve contiguous clusters at the end of an open file (JR addition)
+	Links a run of contiguous free clusters to the end of the file's chain, so the file can
+	grow over them without allocating clusters one at a time. While writing inside the
+	reservation, DFS_WriteFile neither reads nor writes the FAT and can write across
+	cluster boundaries in a single multi-sector write.
+	The file length is not changed : call DFS_TrimFile before forgetting the FILEINFO to
+	return the unused clusters.
+	Requires a SECTOR_SIZE scratch buffer
+	Returns DFS_OK, or DFS_ERRMISC if no run of that size is free (the file is left as it was).
+*/
+uint32_t DFS_ReserveFile(PFILEINFO fileinfo, uint8_t *scratch, uint32_t clusters);
+
+/*
+	Release the clusters reserved past the end of a file (JR addition)
+	Ends the cluster chain at the cluster holding the end of the file, and frees what
+	follows. Does nothing if the file has no reservation.
+	Requires a SECTOR_SIZE scratch buffer
+*/
+uint32_t DFS_TrimFile(PFILEINFO fileinfo, uint8_t *scratch);
+
+/*
+	Build the in-RAM free cluster map of a volume (JR addition)
+	map must point to DFS_FreeMapWords(volinfo) 32-bit words. Each FAT entry is read once
+	and the map is then kept up to date by DFS_SetFAT, so DFS_GetFreeFAT no longer has to
+	scan the FAT on every cluster allocation. Pass a NULL map to drop the map and fall back
+	to the FAT scan.
+	Requires a SECTOR_SIZE scratch buffer
+	Returns DFS_OK, or DFS_ERRMISC if the map could not be built (it is then left disabled).
+*/
+uint32_t DFS_BuildFreeMap(PVOLINFO volinfo, uint8_t *scratch, uint32_t *map, uint32_t mapwords);
+
+/*
+	Number of 32-bit words needed to hold the free cluster map of a volume
+*/
+uint32_t DFS_FreeMapWords(PVOLINFO volinfo);
+
 // If we are building a host-emulation version, include host support
 #ifdef HOSTVER
 #include "hostemu.h"
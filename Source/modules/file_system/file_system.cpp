@@ -37,6 +37,27 @@ namespace fs {
     #endif
 #endif
 
+// multiple sector reads land here rather than in the caller's buffer, which may sit in cached memory, see the note above
+static const u32 read_run_size = MAX_SD_READ_CONSECUTIVE_BLOCKS * SECTOR_SIZE;
+#if ENABLE_SD_DMA && !defined(NO_CACHE_ENABLE) && DDR_LOADER && !FORCE_SD_DMA_BUFFER_STATIC_RAM
+    static u8 read_run_buf[read_run_size] __attribute__ ((section (".ddr_bss_no_cache")));
+#else
+    static u8 read_run_buf[read_run_size] __attribute__ ((section (".iram_bss_no_cache")));
+#endif
+
+#if ENABLE_FS_FAT_CACHE
+    #if !defined(FS_FAT_CACHE_COUNT) || !FS_FAT_CACHE_COUNT
+        #error To enable the FAT cache (ENABLE_FS_FAT_CACHE) you must define FS_FAT_CACHE_COUNT to a value larger than zero
+    #endif
+    static const u32 fat_cache_size = FS_FAT_CACHE_COUNT * SECTOR_SIZE;
+
+    #if ENABLE_SD_DMA && !defined(NO_CACHE_ENABLE) && DDR_LOADER && !FORCE_SD_DMA_BUFFER_STATIC_RAM
+        static u8 fat_cache_buf[fat_cache_size] __attribute__ ((section (".ddr_bss_no_cache"))); // written back to the SD by DMA, see the note above
+    #else
+        static u8 fat_cache_buf[fat_cache_size] __attribute__ ((section (".iram_bss_no_cache")));
+    #endif
+#endif
+
 static VOLINFO vi;
 static volatile bool media_available = false;
 static volatile bool session_creation_failed = false;
@@ -47,13 +68,93 @@ static CTL_MUTEX_t fprintf_buffer_mutex;
 static char fprintf_buffer[512];
 
 #if ENABLE_FS_CACHING
+    // the cache is set-associative : a sector can only be held by the FS_CACHE_WAYS entries of the set its number hashes to.
+    // lookups and replacements only scan that set, whatever the total size of the cache.
+    #if !defined(FS_CACHE_WAYS) || !FS_CACHE_WAYS || (FS_CACHE_COUNT % FS_CACHE_WAYS) || ((FS_CACHE_COUNT / FS_CACHE_WAYS) & (FS_CACHE_COUNT / FS_CACHE_WAYS - 1))
+        #error FS_CACHE_COUNT / FS_CACHE_WAYS must be a power of two
+    #endif
+    static const u32 cache_set_count = FS_CACHE_COUNT / FS_CACHE_WAYS;
+    static const u8 cache_rrpv_max = 3; // 2-bit re-reference prediction values, see allocate_cache()
+
     struct cache_meta
     {
-        u32 age;
         u32 sector;
+        u8 rrpv; // how far in the future this sector is expected to be needed again. 0 : soon, cache_rrpv_max : never
+        bool valid;
+        bool dirty; // only with FS_CACHE_WRITE_BACK
     };
     static cache_meta cache_info[FS_CACHE_COUNT] = {{0}};
-    static u32 age_counter = 0;
+
+    #if FS_CACHE_WRITE_BACK
+        static bool cache_dirty = false;
+        static u32 cache_dirty_time = 0; // in ms, when the cache went from clean to dirty
+        static bool flush_cache(bool force);
+    #endif
+
+    #if ENABLE_FS_STATS
+        static u64 cache_lookup_time = 0; // in system time units
+    #endif
+#endif
+
+#if ENABLE_FS_FAT_CACHE
+    struct fat_cache_meta
+    {
+        u32 age; // 0 when the entry is free
+        u32 sector;
+        bool dirty; // modified since it was read from, or last written back to the SD
+    };
+    static fat_cache_meta fat_cache_info[FS_FAT_CACHE_COUNT] = {{0}};
+    static u32 fat_age_counter = 0;
+    static bool fat_cache_dirty = false;
+    static u32 fat_cache_dirty_time = 0; // in ms, when the cache went from clean to dirty
+    static bool flush_fat_cache(bool force);
+#endif
+
+#if ENABLE_FS_LAZY_DIRENT
+    static bool update_dir_entry(FILE* stream, bool force);
+#endif
+
+#if ENABLE_FS_FREE_MAP
+    static u32 free_map[(FS_FREE_MAP_CLUSTERS + 31) / 32];
+    static bool free_map_used = true;
+#endif
+
+#if ENABLE_FS_SESSION_INDEX
+    // the last session created and the position of its entry in the root : the next session is numbered and created from there,
+    // rather than after scanning the whole root. checked against the entry it points to, with a fallback on the full scan.
+    struct session_index
+    {
+        u32 magic;
+        u32 session;
+        u32 entry_cluster; // with entry_sector, the root directory sector holding the entry of the session. 0 for a FAT12/16 root
+        u32 entry_sector;
+        u32 entry_index; // within that sector
+        u32 start_cluster; // of the session directory
+        u32 check;
+    };
+    static const u32 session_index_magic = 0x58444953; // "SIDX"
+    static const char session_index_name[] = "session.idx";
+    static bool session_index_used = true;
+    static u32 session_index_sector[SECTOR_SIZE / sizeof(u32)];
+#endif
+
+#if ENABLE_FS_LAZY_DIRENT
+    static FILE* lazy_dirent_files[FS_LAZY_DIRENT_FILE_COUNT] = {0}; // files whose directory entries must be written back at the latest on shutdown
+#endif
+
+#if ENABLE_FS_QUEUE
+    // the writes out of the queue blocks are only submitted to the SD : the queue keeps the block until the write completes, see queue::release_blocks
+    struct async_write
+    {
+        u8* buffer;
+        u32 sector;
+        u32 sector_count;
+    };
+    static const u8* async_buffer = 0; // writes out of this range can be left in flight
+    static u32 async_buffer_size = 0;
+    static async_write in_flight_write;
+    static bool write_in_flight = false;
+    static u32 submitted_write_count = 0;
 #endif
 
 #if ENABLE_FS_STATS
@@ -86,11 +187,205 @@ void init()
 void end()
 {
     ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        #if ENABLE_FS_QUEUE
+            if (media_available)
+                complete_async_write(); // the queue normally completed it before ending
+        #endif
+        #if ENABLE_FS_CACHING && FS_CACHE_WRITE_BACK
+            if (media_available)
+                flush_cache(true);
+        #endif
+        #if ENABLE_FS_FAT_CACHE
+            if (media_available)
+                flush_fat_cache(true); // the cluster chains must reach the card before the sizes that refer to them
+        #endif
+        #if ENABLE_FS_LAZY_DIRENT
+            // files which were not closed still need their reservation released and their final size on the card
+            for (u32 i = 0; i < FS_LAZY_DIRENT_FILE_COUNT; ++i)
+            {
+                if (lazy_dirent_files[i] && media_available)
+                    finish_close(lazy_dirent_files[i]);
+                lazy_dirent_files[i] = 0;
+            }
+        #endif
+        #if ENABLE_FS_CACHING && FS_CACHE_WRITE_BACK
+            if (media_available)
+                flush_cache(true); // the directory sectors
+        #endif
         media_available = false;
         session_creation_failed = true;
     ctl_mutex_unlock(&file_system_mutex);
 }
 
+// the session number of a directory entry of the root, 0 if it is not a session directory
+static u32 session_number(const DIRENT& de)
+{
+    if (de.attr != ATTR_DIRECTORY)
+        return 0;
+
+    u32 number = 0;
+    for (u8 i = 0; i < 8; i++)
+    {
+        if (de.name[i] >= '0' && de.name[i] <= '9')
+        {
+            number *= 10;
+            number += de.name[i] - '0';
+        }
+        else if (' ' == de.name[i])
+            break;
+        else
+            return 0;
+    }
+    return number;
+}
+
+// iterate the root directory names, keep the highest session number. leaves di at the start of the root
+static bool scan_sessions(DIRINFO& di, u32& last_session)
+{
+    u8 root_path[] = "";
+    if (DFS_OK != DFS_OpenDir(&vi, root_path, DFS_READ, &di)) // open root directory
+        return false;
+
+    DIRENT de;
+    while (DFS_OK == DFS_GetNext(&vi, &di, &de))
+    {
+        u32 current = session_number(de);
+        if (current > last_session) last_session = current;
+    }
+
+    return DFS_OK == DFS_OpenDir(&vi, root_path, DFS_READ, &di); // the new session takes the first free entry
+}
+
+#if ENABLE_FS_SESSION_INDEX
+static u32 session_index_check(const session_index& index)
+{
+    return ~(index.magic + index.session + index.entry_cluster + index.entry_sector + index.entry_index + index.start_cluster);
+}
+
+static bool read_session_index(session_index& index)
+{
+    FILEINFO fi;
+    u32 read = 0;
+    if (DFS_OK != DFS_OpenFile(&vi, reinterpret_cast<u8*>(const_cast<char*>(session_index_name)), DFS_READ, block_buf, &fi))
+        return false;
+    if (DFS_OK != DFS_ReadFile(&fi, block_buf, reinterpret_cast<u8*>(&index), &read, sizeof(index)) || sizeof(index) != read)
+        return false;
+    return session_index_magic == index.magic && session_index_check(index) == index.check;
+}
+
+static void write_session_index(u32 session, const DIRINFO& di, u32 start_cluster)
+{
+    session_index index;
+    index.magic = session_index_magic;
+    index.session = session;
+    index.entry_cluster = di.currentcluster;
+    index.entry_sector = di.currentsector;
+    index.entry_index = di.currententry - 1;
+    index.start_cluster = start_cluster;
+    index.check = session_index_check(index);
+
+    // DFS_WriteFile writes the last partial sector straight out of the caller's buffer : it must span a whole sector
+    memset(session_index_sector, 0, sizeof(session_index_sector));
+    memcpy(session_index_sector, &index, sizeof(index));
+
+    FILEINFO fi;
+    u32 written = 0;
+    if (DFS_OK == DFS_OpenFile(&vi, reinterpret_cast<u8*>(const_cast<char*>(session_index_name)), DFS_WRITE, block_buf, &fi))
+        DFS_WriteFile(&fi, block_buf, reinterpret_cast<u8*>(session_index_sector), &written, sizeof(index)); // on failure, the next session simply scans the root
+}
+
+// places di on a directory entry of the root, reading the sector holding it
+static bool seek_root_entry(DIRINFO& di, u32 cluster, u32 sector, u32 entry)
+{
+    if (entry >= SECTOR_SIZE / sizeof(DIRENT))
+        return false;
+    if (cluster && (cluster < 2 || cluster >= vi.numclusters + 2 || sector >= vi.secperclus))
+        return false;
+    if (!cluster && (FAT32 == vi.filesystem || sector * (SECTOR_SIZE / sizeof(DIRENT)) >= vi.rootentries))
+        return false;
+
+    di.currentcluster = cluster;
+    di.currentsector = sector;
+    di.currententry = entry;
+    di.flags = 0;
+    u32 lba = cluster ? vi.dataarea + (cluster - 2) * vi.secperclus + sector : vi.rootdir + sector;
+    return DFS_OK == DFS_ReadSector(vi.unit, di.scratch, lba, 1);
+}
+
+// checks that the entry recorded in the index still is the last session directory, then scans only the entries which follow it,
+// in case sessions were added elsewhere. on success, leaves di past the recorded entry : the new session goes after it.
+static bool resume_sessions(const session_index& index, DIRINFO& di, u32& last_session)
+{
+    DIRENT de;
+    if (!seek_root_entry(di, index.entry_cluster, index.entry_sector, index.entry_index))
+        return false;
+    if (DFS_OK != DFS_GetNext(&vi, &di, &de) || session_number(de) != index.session)
+        return false;
+    u32 start_cluster = de.startclus_l_l | (de.startclus_l_h << 8) | (de.startclus_h_l << 16) | (de.startclus_h_h << 24);
+    if (start_cluster != index.start_cluster)
+        return false;
+
+    last_session = index.session;
+    while (DFS_OK == DFS_GetNext(&vi, &di, &de))
+    {
+        u32 current = session_number(de);
+        if (current > last_session) last_session = current;
+    }
+
+    return seek_root_entry(di, index.entry_cluster, index.entry_sector, index.entry_index) && DFS_OK == DFS_GetNext(&vi, &di, &de);
+}
+#endif
+
+// determines the next session number, and creates its directory. the caller must hold the file system mutex
+static bool open_session()
+{
+    DIRINFO di;
+    di.scratch = block_buf;
+    u32 last_session = 0;
+    bool found = false;
+
+    #if ENABLE_FS_SESSION_INDEX
+        if (session_index_used)
+        {
+            session_index index;
+            found = read_session_index(index) && resume_sessions(index, di, last_session);
+        }
+    #endif
+    if (!found)
+    {
+        last_session = 0;
+        if (!scan_sessions(di, last_session))
+            return false;
+    }
+
+    // convert the maximum number + 1 to the current directory's name
+    char name[10];
+    u32 number = last_session + 1;
+    u8 pos = 0;
+    while (number)
+    {
+        name[7 - pos++] = (number % 10) + '0';
+        number /= 10;
+    }
+    for (u8 i = 0; i < pos; ++i)
+        name[i] = name[8 - pos + i];
+    name[pos] = 0;
+
+    u32 start_cluster;
+    if (DFS_OK != DFS_MakeDir(&vi, &di, reinterpret_cast<u8*>(name), &start_cluster))
+        return false;
+
+    #if ENABLE_FS_SESSION_INDEX
+        DFS_SetDirHint(&vi, reinterpret_cast<u8*>(name), session_index_used ? start_cluster : 0); // the files of the session are opened without scanning the root
+        write_session_index(last_session + 1, di, start_cluster);
+    #endif
+
+    strcpy(current_directory, name);
+    current_directory[pos] = '/';
+    current_directory[pos + 1] = 0;
+    return true;
+}
+
 void create_session()
 {
     if (session_creation_failed)
@@ -113,64 +408,17 @@ void create_session()
             ctl_mutex_unlock(&file_system_mutex);
             return;
         }
+
+        #if ENABLE_FS_FREE_MAP
+            if (free_map_used)
+                DFS_BuildFreeMap(&vi, block_buf, free_map, sizeof(free_map) / sizeof(u32)); // on failure, allocations simply fall back to the FAT scan
+        #endif
     
-        // determine the next directory we will use for all our files
-        // iterate current directory names, choose next higher number
-        DIRINFO di;
-        di.scratch = block_buf;
-        u8 root_path[] = "";
-        status = DFS_OpenDir(&vi, root_path, DFS_READ, &di); // open root directory
-        if (DFS_OK != status)
+        if (!open_session())
         {
             ctl_mutex_unlock(&file_system_mutex);
             return;
         }
-    
-        // convert each dir name into an unsigned number, and keep the maximum
-        u32 max_num = 0;
-        DIRENT de;
-        while (DFS_OK == status)
-        {
-            status = DFS_GetNext(&vi, &di, &de);
-    
-            if (DFS_OK != status)
-                break;
-    
-            if (de.attr != ATTR_DIRECTORY)
-                continue;
-            
-            u32 current = 0;
-            for (u8 i = 0; i < 8; i++)
-            {
-                if (de.name[i] >= '0' && de.name[i] <= '9')
-                {
-                    current *= 10;
-                    current += de.name[i] - '0';
-                }
-                else if (' ' == de.name[i])
-                    break;
-                else
-                {
-                    current = 0;
-                    break;
-                }
-            }
-    
-            if (current > max_num) max_num = current;
-        }
-    
-        // convert the maximum number + 1 to the current directory's name
-        max_num += 1;
-        u8 pos = 0;
-        while (max_num)
-        {
-            current_directory[7 - pos++] = (max_num % 10) + '0';
-            max_num /= 10;
-        }
-        for (u8 i = 0; i < pos; ++i)
-            current_directory[i] = current_directory[8 - pos + i];
-        current_directory[pos] = '/';
-        current_directory[pos + 1] = 0;
 
         media_available = true;
         session_creation_failed = false;
@@ -178,14 +426,143 @@ void create_session()
     ctl_mutex_unlock(&file_system_mutex);
 }
 
+#if ENABLE_FS_SESSION_INDEX
+void use_session_index(bool use)
+{
+    ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        session_index_used = use;
+    ctl_mutex_unlock(&file_system_mutex);
+}
+#endif
+
+bool new_session()
+{
+    if (!media_available)
+    {
+        create_session(); // which opens the first session
+        return !session_creation_failed;
+    }
+
+    ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        bool opened = open_session();
+    ctl_mutex_unlock(&file_system_mutex);
+
+    return opened;
+}
+
 #if ENABLE_FS_STATS
 const fs_stats& get_stats()
 {
+    #if ENABLE_FS_CACHING
+        if (file_system_stats.cache_accesses)
+        {
+            file_system_stats.cache_hit_rate = static_cast<u32>(static_cast<u64>(file_system_stats.cache_hits) * 100 / file_system_stats.cache_accesses);
+            file_system_stats.cache_lookup_ns = static_cast<u32>(cache_lookup_time * 1000000000ull / get_hw_clock().get_system_freq() / file_system_stats.cache_accesses);
+        }
+    #endif
+    #if ENABLE_FS_FREE_MAP
+        file_system_stats.free_clusters = vi.freemap ? vi.freecount : 0;
+    #endif
     return file_system_stats;
 }
 #endif
 
-bool fopen(FILE* stream, const char* filename, char mode, bool root)
+bool sync_file(FILE* stream, bool force)
+{
+    bool success = true;
+    #if ENABLE_FS_CACHING && FS_CACHE_WRITE_BACK
+        success = flush_cache(force) && success; // partial data sectors
+    #endif
+    #if ENABLE_FS_FAT_CACHE
+        success = flush_fat_cache(force) && success; // the cluster chain must reach the card before the size that refers to it
+    #endif
+    #if ENABLE_FS_LAZY_DIRENT
+        success = update_dir_entry(stream, force) && success;
+    #endif
+    #if ENABLE_FS_CACHING && FS_CACHE_WRITE_BACK
+        success = flush_cache(force) && success; // the directory sector
+    #endif
+    return success;
+}
+
+bool finish_close(FILE* stream)
+{
+    bool success = true;
+    #if ENABLE_FS_PREALLOCATION
+        success = DFS_OK == DFS_TrimFile(&stream->fileinfo, block_buf);
+    #endif
+    return sync_file(stream, true) && success;
+}
+
+#if ENABLE_FS_LAZY_DIRENT
+static bool update_dir_entry(FILE* stream, bool force)
+{
+    if (!stream->fileinfo.direntdirty)
+        return true;
+
+    u32 now = get_hw_clock().get_millisec_time();
+    if (!force && now - stream->dirent_update_time < FS_DIRENT_UPDATE_INTERVAL_MS)
+        return true;
+
+    stream->dirent_update_time = now;
+    return DFS_OK == DFS_UpdateDirEnt(&stream->fileinfo, block_buf);
+}
+
+// the caller must hold the file system mutex
+static bool register_lazy_dirent(FILE* stream)
+{
+    u32 free_slot = FS_LAZY_DIRENT_FILE_COUNT;
+    for (u32 i = 0; i < FS_LAZY_DIRENT_FILE_COUNT; ++i)
+    {
+        if (lazy_dirent_files[i] == stream)
+            return true;
+        if (0 == lazy_dirent_files[i] && FS_LAZY_DIRENT_FILE_COUNT == free_slot)
+            free_slot = i;
+    }
+    if (FS_LAZY_DIRENT_FILE_COUNT == free_slot)
+        return false;
+    lazy_dirent_files[free_slot] = stream;
+    return true;
+}
+
+static void unregister_lazy_dirent(FILE* stream)
+{
+    ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        for (u32 i = 0; i < FS_LAZY_DIRENT_FILE_COUNT; ++i)
+        {
+            if (lazy_dirent_files[i] == stream)
+                lazy_dirent_files[i] = 0;
+        }
+    ctl_mutex_unlock(&file_system_mutex);
+}
+#endif
+
+#if ENABLE_FS_FREE_MAP
+void use_free_map(bool use)
+{
+    ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        free_map_used = use;
+        if (media_available) // otherwise, the session creation will take care of it
+            DFS_BuildFreeMap(&vi, block_buf, use ? free_map : 0, sizeof(free_map) / sizeof(u32)); // the map is not maintained while unused : rebuild it
+    ctl_mutex_unlock(&file_system_mutex);
+}
+
+u32 find_free_cluster()
+{
+    if (!media_available)
+        create_session();
+    if (session_creation_failed)
+        return 0x0ffffff7;
+
+    ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+        u32 cluster = DFS_GetFreeFAT(&vi, block_buf);
+    ctl_mutex_unlock(&file_system_mutex);
+
+    return cluster;
+}
+#endif
+
+bool fopen(FILE* stream, const char* filename, char mode, bool root, u32 reserve_mb)
 {
     char path[64];
     path[0] = 0;
@@ -214,8 +591,21 @@ bool fopen(FILE* stream, const char* filename, char mode, bool root)
         strcpy(path + strlen(path), filename);
     
         status = DFS_OpenFile(&vi, reinterpret_cast<u8*>(const_cast<char*>(path)), mask, block_buf, &stream->fileinfo);
+        #if ENABLE_FS_LAZY_DIRENT
+            // only an opened file takes a slot, fs::end finishes the files left in them
+            if (status == DFS_OK && (mask & DFS_WRITE) && register_lazy_dirent(stream)) // if no slot is left, the file simply updates its entry on every write
+                stream->fileinfo.mode |= DFS_LAZY_DIRENT;
+            stream->dirent_update_time = get_hw_clock().get_millisec_time();
+        #endif
         if (status == DFS_OK && mode == 'a')
             DFS_Seek(&stream->fileinfo, stream->fileinfo.filelen, block_buf);
+        #if ENABLE_FS_PREALLOCATION
+            if (status == DFS_OK && (mask & DFS_WRITE) && reserve_mb)
+            {
+                u32 cluster_size = vi.secperclus * SECTOR_SIZE;
+                DFS_ReserveFile(&stream->fileinfo, block_buf, (reserve_mb * 1024 * 1024 + cluster_size - 1) / cluster_size); // only a hint : without enough contiguous space, the file grows one cluster at a time
+            }
+        #endif
         stream->write_byte_count = 0;
         stream->hw_block_pos = stream->fileinfo.filelen % write_buffer_size;
 
@@ -223,7 +613,7 @@ bool fopen(FILE* stream, const char* filename, char mode, bool root)
 
     #if ENABLE_FS_QUEUE
         stream->write_buf = 0;
-        if (mode == 'w' || mode == 'a')
+        if (status == DFS_OK && (mode == 'w' || mode == 'a')) // a failed open is never closed, it must not hold a block
         {
             get_fs_queue().enqueue_write(stream, 0); // will not trigger a write : simply allocate a buffer for us
         }
@@ -237,6 +627,23 @@ int fclose(FILE* stream)
     if (0 == stream || 0 == stream->fileinfo.volinfo)
         return 0;
     fflush(stream);
+    #if !ENABLE_FS_QUEUE
+        ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+            finish_close(stream);
+        ctl_mutex_unlock(&file_system_mutex);
+    #else
+        if (get_fs_queue().is_running())
+            get_fs_queue().enqueue_close(stream); // the reservation is still being written to by the queued blocks
+        else if (media_available) // nothing left to write for the file, release its reservation now
+        {
+            ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+                finish_close(stream);
+            ctl_mutex_unlock(&file_system_mutex);
+        }
+    #endif
+    #if ENABLE_FS_LAZY_DIRENT
+        unregister_lazy_dirent(stream);
+    #endif
     #if !ENABLE_FS_QUEUE // the file system queue may not be done yet, don't memset in that case
         memset(stream, 0, sizeof(FILE));
     #endif
@@ -341,14 +748,66 @@ size_t fwrite(const void* ptr, size_t size, size_t count, FILE* stream)
                 write_count += total_size;
             }
         }
-        
+
     #if !ENABLE_FS_QUEUE
+        sync_file(stream, false); // periodic write back of the metadata. the queue does this on its side
         ctl_mutex_unlock(&file_system_mutex);
     #endif
     
     return write_count;
 }
 
+#if ENABLE_FS_ZERO_COPY
+u8* reserve(FILE* stream, u32 size)
+{
+    if (0 == stream || 0 == stream->fileinfo.volinfo)
+        return 0;
+
+    if (!media_available)
+        create_session();
+    if (session_creation_failed)
+        return 0;
+
+    #if ENABLE_FS_QUEUE
+        if (0 == stream->write_buf) // not opened for writing
+            return 0;
+    #endif
+
+    if (stream->write_byte_count + size > write_buffer_size - stream->hw_block_pos) // the bytes would straddle the end of the buffer
+        return 0;
+
+    return stream->write_buf + stream->write_byte_count;
+}
+
+size_t commit(FILE* stream, u32 used)
+{
+    if (0 == stream || 0 == stream->fileinfo.volinfo)
+        return 0;
+
+    assert_fs_safe(stream->write_byte_count + used <= write_buffer_size - stream->hw_block_pos);
+    stream->write_byte_count += used;
+
+    if (stream->write_byte_count < write_buffer_size - stream->hw_block_pos)
+        return used;
+
+    // the buffer is full : written exactly as fwrite writes its buffered part
+    u32 successfully_written_bytes = 0;
+    #if !ENABLE_FS_QUEUE
+        ctl_mutex_lock(&file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+            DFS_WriteFile(&stream->fileinfo, block_buf, stream->write_buf, &successfully_written_bytes, stream->write_byte_count);
+            sync_file(stream, false);
+        ctl_mutex_unlock(&file_system_mutex);
+    #else
+        get_fs_queue().enqueue_write(stream, stream->write_byte_count);
+        successfully_written_bytes = stream->write_byte_count;
+    #endif
+    stream->hw_block_pos = 0;
+    stream->write_byte_count -= successfully_written_bytes;
+
+    return used;
+}
+#endif
+
 size_t fprintf(FILE* stream, const char *fmt, ...)
 {
     va_list args;
@@ -404,6 +863,14 @@ int fflush(FILE* stream, bool blocking)
             stream->hw_block_pos += successfully_written_bytes; // we are not aligned anymore
         }
 
+        #if !ENABLE_FS_QUEUE
+            if (!sync_file(stream, true))
+                status = DFS_ERRMISC;
+        #else
+            if (get_fs_queue().is_running())
+                get_fs_queue().enqueue_sync(stream); // must reach the card after the data queued above
+        #endif
+
     #if !ENABLE_FS_QUEUE
         ctl_mutex_unlock(&file_system_mutex);
     #endif
@@ -448,9 +915,28 @@ void debug()
 
 // implementation of the read and write functions for dosfs
 
+#if ENABLE_FS_STATS
+    static void count_written_sectors(u32 sector_count)
+    {
+        current_write_byte_count += SECTOR_SIZE * sector_count;
+        us current_time = get_hw_clock().get_microsec_time();
+        us delay = current_time - current_write_measure_start;
+        if (delay > 1000000)
+        {
+            file_system_stats.write_bytes_per_sec = static_cast<u32>(static_cast<float>(current_write_byte_count) / static_cast<float>(delay) * 1000000.f);
+            current_write_measure_start = current_time;
+            current_write_byte_count = 0;
+        }
+    }
+#endif
+
 bool write_sector(uint8_t *buffer, uint32_t sector, uint32_t sector_count)
 {
     assert_fs_safe(sector < 0x400000);
+    #if ENABLE_FS_QUEUE
+        if (!complete_async_write()) // keep the writes in order
+            return false;
+    #endif
     static const u32 error_count_max = 10;
     bool success = false;
     u32 attempt;
@@ -460,15 +946,7 @@ bool write_sector(uint8_t *buffer, uint32_t sector, uint32_t sector_count)
         if (success)
         {
             #if ENABLE_FS_STATS
-                current_write_byte_count += SECTOR_SIZE * sector_count;
-                us current_time = get_hw_clock().get_microsec_time();
-                us delay = current_time - current_write_measure_start;
-                if (delay > 1000000)
-                {
-                    file_system_stats.write_bytes_per_sec = static_cast<u32>(static_cast<float>(current_write_byte_count) / static_cast<float>(delay) * 1000000.f);
-                    current_write_measure_start = current_time;
-                    current_write_byte_count = 0;
-                }
+                count_written_sectors(sector_count);
             #endif
             break;
         }
@@ -481,19 +959,23 @@ bool write_sector(uint8_t *buffer, uint32_t sector, uint32_t sector_count)
     return true;
 }
 
-bool read_sector(uint8_t *buffer, uint32_t sector)
+bool read_sector(uint8_t *buffer, uint32_t sector, uint32_t sector_count = 1)
 {
     assert_fs_safe(sector < 0x400000);
+    #if ENABLE_FS_QUEUE
+        if (!complete_async_write()) // the sector may be the one being written
+            return false;
+    #endif
     static const u32 error_count_max = 10;
     bool success = false;
     u32 attempt;
     for (attempt = 0; attempt < error_count_max; ++attempt)
     {
-        success = get_sd().read_block(sector, buffer);
+        success = get_sd().read_blocks(sector, buffer, sector_count);
         if (success)
         {
             #if ENABLE_FS_STATS
-                current_read_byte_count += SECTOR_SIZE;
+                current_read_byte_count += SECTOR_SIZE * sector_count;
                 us current_time = get_hw_clock().get_microsec_time();
                 us delay = current_time - current_read_measure_start;
                 if (delay > 1000000)
@@ -514,48 +996,177 @@ bool read_sector(uint8_t *buffer, uint32_t sector)
     return true;
 }
 
+#if ENABLE_FS_QUEUE
+void set_async_buffer(const u8* buffer, u32 size)
+{
+    async_buffer = buffer;
+    async_buffer_size = size;
+}
+
+static bool is_async_buffer(const u8* buffer)
+{
+    return async_buffer && buffer >= async_buffer && buffer < async_buffer + async_buffer_size;
+}
+
+// returns as soon as the transfer is started. the previous one must be over by then, so what overlaps is the transfer of one block
+// with the work done on the next one (the FAT and directory updates, the memory copies, the queue handling)
+static bool write_sector_async(uint8_t *buffer, uint32_t sector, uint32_t sector_count)
+{
+    assert_fs_safe(sector < 0x400000);
+    if (!complete_async_write())
+        return false;
+    if (!get_sd().submit_write(sector, buffer, sector_count))
+        return write_sector(buffer, sector, sector_count);
+    in_flight_write.buffer = buffer;
+    in_flight_write.sector = sector;
+    in_flight_write.sector_count = sector_count;
+    write_in_flight = true;
+    ++submitted_write_count;
+    return true;
+}
+
+bool complete_async_write()
+{
+    if (!write_in_flight)
+        return true;
+    write_in_flight = false;
+
+    bool success = get_sd().complete_write();
+    if (success)
+    {
+        #if ENABLE_FS_STATS
+            count_written_sectors(in_flight_write.sector_count);
+        #endif
+    }
+    else // retry synchronously, the buffer is still held by the queue
+        success = write_sector(in_flight_write.buffer, in_flight_write.sector, in_flight_write.sector_count);
+    return success;
+}
+
+u32 get_submitted_writes()
+{
+    return submitted_write_count;
+}
+
+u32 get_completed_writes()
+{
+    return write_in_flight ? submitted_write_count - 1 : submitted_write_count;
+}
+#endif
+
 #if ENABLE_FS_CACHING
-    u32 allocate_cache()
+    u32 get_cache_set(u32 sector)
     {
-        u32 oldest_age = 0xFFFFFFFF, oldest_cache = 0;
-        for (u32 i = 0; i < FS_CACHE_COUNT; ++i)
+        // consecutive sectors land in consecutive sets. folding the upper bits in spreads the FAT and directory sectors,
+        // which sit at fixed places on the volume, away from each other
+        return (sector ^ (sector / cache_set_count) ^ (sector / (cache_set_count * cache_set_count))) & (cache_set_count - 1);
+    }
+
+    bool write_back_cache(u32 index)
+    {
+        #if FS_CACHE_WRITE_BACK
+            if (!cache_info[index].valid || !cache_info[index].dirty)
+                return true;
+            if (!write_sector(&cache_block_buf[index * SECTOR_SIZE], cache_info[index].sector, 1))
+                return false;
+            cache_info[index].dirty = false;
+            #if ENABLE_FS_STATS
+                ++file_system_stats.cache_write_backs;
+            #endif
+        #endif
+        return true;
+    }
+
+    // replacement is a static re-reference interval prediction (SRRIP) : new sectors are inserted as "needed in a distant future",
+    // and only promoted when they get hit. a long sequential read thus only cycles through the entries it brought in,
+    // instead of flushing out the FAT and directory sectors as the former global LRU did.
+    u32 allocate_cache(u32 set, bool& success)
+    {
+        u32 first = set * FS_CACHE_WAYS;
+        u32 victim = first;
+        bool found = false;
+
+        for (u32 i = first; i < first + FS_CACHE_WAYS; ++i)
         {
-            if (cache_info[i].age < oldest_age)
+            if (!cache_info[i].valid)
             {
-                oldest_age = cache_info[i].age;
-                oldest_cache = i;
+                victim = i;
+                found = true;
+                break;
             }
         }
 
-        cache_info[oldest_cache].age = ++age_counter;
+        while (!found)
+        {
+            for (u32 i = first; i < first + FS_CACHE_WAYS; ++i)
+            {
+                if (cache_info[i].rrpv >= cache_rrpv_max)
+                {
+                    victim = i;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) // age the whole set, at most cache_rrpv_max times
+            {
+                for (u32 i = first; i < first + FS_CACHE_WAYS; ++i)
+                    ++cache_info[i].rrpv;
+            }
+        }
 
-        return oldest_cache;
+        success = write_back_cache(victim);
+        cache_info[victim].valid = false;
+        cache_info[victim].dirty = false;
+        cache_info[victim].rrpv = cache_rrpv_max - 1;
+        return victim;
+    }
+
+    u32 find_cache(u32 sector, bool& success)
+    {
+        u32 first = get_cache_set(sector) * FS_CACHE_WAYS;
+        for (u32 i = first; i < first + FS_CACHE_WAYS; ++i)
+        {
+            if (cache_info[i].valid && cache_info[i].sector == sector)
+            {
+                success = true;
+                cache_info[i].rrpv = 0; // this cache is being reused
+                return i;
+            }
+        }
+        success = false;
+        return first;
     }
 
     u32 get_read_cache(u32 sector, bool& success)
     {
         #if ENABLE_FS_STATS
             ++file_system_stats.cache_accesses;
+            u64 lookup_begin = get_hw_clock().get_system_time();
         #endif
 
-        for (u32 i = 0; i < FS_CACHE_COUNT; ++i)
+        u32 cache_index = find_cache(sector, success);
+
+        #if ENABLE_FS_STATS
+            cache_lookup_time += get_hw_clock().get_system_time() - lookup_begin;
+        #endif
+
+        if (success)
         {
-            if (cache_info[i].age > 0 && cache_info[i].sector == sector)
-            {
-                success = true;
-                cache_info[i].age = ++age_counter; // this cache is being reused - refresh its age
-                #if ENABLE_FS_STATS
-                    ++file_system_stats.cache_hits;
-                #endif
-                return i;
-            }
+            #if ENABLE_FS_STATS
+                ++file_system_stats.cache_hits;
+            #endif
+            return cache_index;
         }
-        
-        // we haven't found the block in the cache. allocate one.
-        u32 cache_index = allocate_cache();
 
-        cache_info[cache_index].sector = sector;
-        success = read_sector(&cache_block_buf[cache_index * SECTOR_SIZE], sector);
+        // we haven't found the block in the cache. allocate one.
+        cache_index = allocate_cache(get_cache_set(sector), success);
+        if (success)
+            success = read_sector(&cache_block_buf[cache_index * SECTOR_SIZE], sector);
+        if (success)
+        {
+            cache_info[cache_index].sector = sector;
+            cache_info[cache_index].valid = true;
+        }
 
         #if ENABLE_FS_STATS
             ++file_system_stats.cache_misses;
@@ -564,42 +1175,179 @@ bool read_sector(uint8_t *buffer, uint32_t sector)
         return cache_index;
     }
 
-    u32 get_write_cache(u32 sector, bool& success)
+    // allocate : with FS_CACHE_WRITE_BACK, take an entry for a sector about to be fully written, rather than only updating a cached copy.
+    // without it, this is only a coherence check for the write-through path, which does not count towards the hit rate.
+    u32 get_write_cache(u32 sector, bool allocate, bool& success)
     {
         #if ENABLE_FS_STATS
-            ++file_system_stats.cache_accesses;
+            u64 lookup_begin = get_hw_clock().get_system_time();
+        #endif
+
+        u32 cache_index = find_cache(sector, success);
+
+        #if ENABLE_FS_STATS
+            if (allocate)
+            {
+                cache_lookup_time += get_hw_clock().get_system_time() - lookup_begin;
+                ++file_system_stats.cache_accesses;
+                if (success)
+                    ++file_system_stats.cache_hits;
+                else
+                    ++file_system_stats.cache_misses;
+            }
         #endif
 
-        for (u32 i = 0; i < FS_CACHE_COUNT; ++i)
+        if (success || !allocate)
+            return cache_index;
+
+        cache_index = allocate_cache(get_cache_set(sector), success);
+        if (success)
+        {
+            cache_info[cache_index].sector = sector;
+            cache_info[cache_index].valid = true;
+        }
+        return cache_index;
+    }
+
+    #if FS_CACHE_WRITE_BACK
+        void mark_cache_dirty(u32 index)
         {
-            if (cache_info[i].age > 0 && cache_info[i].sector == sector)
+            cache_info[index].dirty = true;
+            if (!cache_dirty)
+            {
+                cache_dirty = true;
+                cache_dirty_time = get_hw_clock().get_millisec_time();
+            }
+        }
+
+        static bool flush_cache(bool force)
+        {
+            if (!cache_dirty)
+                return true;
+            if (!force && get_hw_clock().get_millisec_time() - cache_dirty_time < FS_CACHE_FLUSH_INTERVAL_MS)
+                return true;
+
+            bool success = true;
+            for (u32 i = 0; i < FS_CACHE_COUNT; ++i)
+                success = write_back_cache(i) && success;
+            cache_dirty = !success;
+            return success;
+        }
+    #endif
+#endif
+
+#if ENABLE_FS_FAT_CACHE
+    // FAT sectors are kept apart from the other blocks : dosfs reads and rewrites the same few FAT sectors for every cluster
+    // it links, so they are written back to the SD only on sync, when evicted, or after FS_FAT_CACHE_FLUSH_INTERVAL_MS
+    bool is_fat_sector(u32 sector)
+    {
+        return sector >= vi.fat1 && sector < vi.fat1 + 2 * vi.secperfat; // both copies. empty range until the volume info is read
+    }
+
+    bool write_back_fat_cache(u32 index)
+    {
+        if (!fat_cache_info[index].dirty)
+            return true;
+        if (!write_sector(&fat_cache_buf[index * SECTOR_SIZE], fat_cache_info[index].sector, 1))
+            return false;
+        fat_cache_info[index].dirty = false;
+        #if ENABLE_FS_STATS
+            ++file_system_stats.fat_cache_flushes;
+        #endif
+        return true;
+    }
+
+    u32 get_fat_cache(u32 sector, bool load, bool& success) // load : read the sector from the SD on a miss. not needed when it is about to be fully overwritten
+    {
+        for (u32 i = 0; i < FS_FAT_CACHE_COUNT; ++i)
+        {
+            if (fat_cache_info[i].age > 0 && fat_cache_info[i].sector == sector)
             {
                 success = true;
-                cache_info[i].age = ++age_counter; // this cache is being reused - refresh its age
+                fat_cache_info[i].age = ++fat_age_counter;
                 #if ENABLE_FS_STATS
-                    ++file_system_stats.cache_hits;
+                    ++file_system_stats.fat_cache_hits;
                 #endif
                 return i;
             }
         }
 
-        success = false;
-        return 0;
-    }
+        #if ENABLE_FS_STATS
+            ++file_system_stats.fat_cache_misses;
+        #endif
 
-    void invalidate_cache(u32 sector)
-    {
-        for (u32 i = 0; i < FS_CACHE_COUNT; ++i)
+        // evict the least recently used sector. if it is dirty, it must reach the SD first
+        u32 oldest_age = 0xFFFFFFFF, oldest_cache = 0;
+        for (u32 i = 0; i < FS_FAT_CACHE_COUNT; ++i)
         {
-            if (cache_info[i].sector == sector)
+            if (fat_cache_info[i].age < oldest_age)
             {
-                cache_info[i].age = 0;
-                return;
+                oldest_age = fat_cache_info[i].age;
+                oldest_cache = i;
             }
         }
+
+        success = write_back_fat_cache(oldest_cache);
+        if (!success)
+            return oldest_cache;
+
+        fat_cache_info[oldest_cache].sector = sector;
+        fat_cache_info[oldest_cache].age = ++fat_age_counter;
+        if (load)
+        {
+            success = read_sector(&fat_cache_buf[oldest_cache * SECTOR_SIZE], sector);
+            if (!success)
+                fat_cache_info[oldest_cache].age = 0;
+        }
+
+        return oldest_cache;
+    }
+
+    void mark_fat_cache_dirty(u32 index)
+    {
+        fat_cache_info[index].dirty = true;
+        if (!fat_cache_dirty)
+        {
+            fat_cache_dirty = true;
+            fat_cache_dirty_time = get_hw_clock().get_millisec_time();
+        }
+    }
+
+    static bool flush_fat_cache(bool force)
+    {
+        if (!fat_cache_dirty)
+            return true;
+        if (!force && get_hw_clock().get_millisec_time() - fat_cache_dirty_time < FS_FAT_CACHE_FLUSH_INTERVAL_MS)
+            return true;
+
+        bool success = true;
+        for (u32 i = 0; i < FS_FAT_CACHE_COUNT; ++i)
+            success = write_back_fat_cache(i) && success;
+        fat_cache_dirty = !success;
+        return success;
     }
 #endif
 
+// a run of consecutive data sectors, read with a single multiple block command. the cache is not filled from here, as such runs
+// are streamed file contents which would only evict more useful sectors, but cached copies are more recent than the SD when dirty
+bool read_sector_run(u8* buffer, u32 sector, u32 sector_count)
+{
+    assert_fs_safe(sector_count <= MAX_SD_READ_CONSECUTIVE_BLOCKS);
+    if (!read_sector(read_run_buf, sector, sector_count))
+        return false;
+    memcpy(buffer, read_run_buf, sector_count * SECTOR_SIZE);
+    #if ENABLE_FS_CACHING
+        for (u32 i = 0; i < sector_count; ++i)
+        {
+            bool found;
+            u32 cache_index = find_cache(sector + i, found);
+            if (found)
+                memcpy(buffer + i * SECTOR_SIZE, &cache_block_buf[cache_index * SECTOR_SIZE], SECTOR_SIZE);
+        }
+    #endif
+    return true;
+}
+
 }
 
 uint32_t DFS_ReadSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t count)
@@ -607,8 +1355,24 @@ uint32_t DFS_ReadSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t
     assert_fs_safe(sector < 0x400000);
     if (sector >= 0x400000)
         return 0xFFFFFFFF;
-    assert_fs_safe(count == 1); // dosfs guarantees this
     bool success;
+    if (count > 1) // only data sectors of a file are read in runs, see DFS_ReadFile
+    {
+        success = fs::read_sector_run(buffer, sector, count);
+        if (success)
+            return 0;
+        return 0xFFFFFFFF;
+    }
+    #if ENABLE_FS_FAT_CACHE
+        if (fs::is_fat_sector(sector))
+        {
+            u32 fat_index = fs::get_fat_cache(sector, true, success);
+            if (!success)
+                return 0xFFFFFFFF;
+            memcpy(buffer, &fs::fat_cache_buf[fat_index * SECTOR_SIZE], SECTOR_SIZE);
+            return 0;
+        }
+    #endif
     #if ENABLE_FS_CACHING
         u32 cache_index = fs::get_read_cache(sector, success);
         if (!success)
@@ -622,19 +1386,62 @@ uint32_t DFS_ReadSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t
     return 0xFFFFFFFF;
 }
 
+uint32_t DFS_FlushFAT(uint8_t unit)
+{
+    #if ENABLE_FS_FAT_CACHE
+        if (!fs::flush_fat_cache(true))
+            return 0xFFFFFFFF;
+    #endif
+    return 0;
+}
+
 uint32_t DFS_WriteSector(uint8_t unit, uint8_t *buffer, uint32_t sector, uint32_t count)
 {
     assert_fs_safe(sector < 0x400000);
     if (sector >= 0x400000)
         return 0xFFFFFFFF;
     bool success;
+    #if ENABLE_FS_FAT_CACHE
+        if (1 == count && fs::is_fat_sector(sector)) // dosfs writes the FAT one sector at a time
+        {
+            u32 fat_index = fs::get_fat_cache(sector, false, success);
+            if (!success)
+                return 0xFFFFFFFF;
+            memcpy(&fs::fat_cache_buf[fat_index * SECTOR_SIZE], buffer, SECTOR_SIZE);
+            fs::mark_fat_cache_dirty(fat_index);
+            return 0;
+        }
+    #endif
     #if ENABLE_FS_CACHING
+        #if FS_CACHE_WRITE_BACK
+            if (1 == count) // single sectors are directory entries and partial data sectors, likely to be rewritten soon : keep them in the cache
+            {
+                u32 cache_index = fs::get_write_cache(sector, true, success);
+                if (!success)
+                    return 0xFFFFFFFF;
+                memcpy(&fs::cache_block_buf[cache_index * SECTOR_SIZE], buffer, SECTOR_SIZE);
+                fs::mark_cache_dirty(cache_index);
+                return 0;
+            }
+        #endif
         // simply update the cache if it was allocated, but write through to SD in any case
         for (u32 i = 0; i < count; ++i)
         {
-            u32 cache_index = fs::get_write_cache(sector + i, success);
+            u32 cache_index = fs::get_write_cache(sector + i, false, success);
             if (success)
+            {
                 memcpy(&fs::cache_block_buf[cache_index * SECTOR_SIZE], buffer + (i * SECTOR_SIZE), SECTOR_SIZE);
+                fs::cache_info[cache_index].dirty = false; // about to be written
+            }
+        }
+    #endif
+    #if ENABLE_FS_QUEUE
+        if (fs::is_async_buffer(buffer)) // a queue block, see fs::set_async_buffer
+        {
+            success = fs::write_sector_async(buffer, sector, count);
+            if (success)
+                return 0;
+            return 0xFFFFFFFF;
         }
     #endif
     success = fs::write_sector(buffer, sector, count);
@@ -670,4 +1477,9 @@ uint8_t DFS_GetTime(uint16_t* year, uint8_t* month, uint8_t* day, uint8_t* hour,
 uint32_t DFS_GetMaxBlockCount()
 {
     return MAX_SD_WRITE_CONSECUTIVE_BLOCKS;
+}
+
+uint32_t DFS_GetMaxReadBlockCount()
+{
+    return MAX_SD_READ_CONSECUTIVE_BLOCKS;
 }
\ No newline at end of file
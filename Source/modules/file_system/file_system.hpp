@@ -18,6 +18,9 @@ struct FILE
     #endif
     u32 write_byte_count; // where are we in the write_buf?
     u32 hw_block_pos; // used to track where we are in the actual disk block. this is important if we made a partial block write in the past, to make sure our write_buf can be realigned.
+    #if ENABLE_FS_LAZY_DIRENT
+        u32 dirent_update_time; // in ms, last time the directory entry was written back
+    #endif
 };
 
 #if ENABLE_FS_STATS
@@ -26,8 +29,19 @@ struct FILE
         u32 cache_accesses;
         u32 cache_hits;
         u32 cache_misses;
+        u32 cache_hit_rate; // in percent
+        u32 cache_lookup_ns; // mean time spent finding a sector in the cache, hit or miss
+        u32 cache_write_backs; // dirty sectors written to the card, with FS_CACHE_WRITE_BACK
         u32 write_bytes_per_sec;
         u32 read_bytes_per_sec;
+        #if ENABLE_FS_FREE_MAP
+            u32 free_clusters; // 0 if the free cluster map could not be built
+        #endif
+        #if ENABLE_FS_FAT_CACHE
+            u32 fat_cache_hits;
+            u32 fat_cache_misses;
+            u32 fat_cache_flushes; // FAT sectors written back to the card
+        #endif
     };
 #endif
 
@@ -38,24 +52,54 @@ void end();
     const fs_stats& get_stats();
 #endif
 
-bool fopen(FILE* stream, const char* filename, char mode, bool root = false); // support for 'r', 'w' and 'a' only. 'w' creates any directory needed for the given path. 'a' is like 'w' but seeks at the end of the file before writing.
+// used by the file system queue to run these in order with the queued writes. the caller must hold the file system mutex
+bool sync_file(FILE* stream, bool force); // writes back the metadata held in RAM (FAT sectors, directory entry). unless forced, only what is older than its flush interval
+bool finish_close(FILE* stream); // releases the clusters reserved past the end of the file, and syncs it
+
+#if ENABLE_FS_QUEUE
+    // used by the file system queue to leave the write of a block in flight while it works on the next one. the caller must hold the file system mutex
+    void set_async_buffer(const u8* buffer, u32 size); // writes straight out of this range are only submitted to the SD. 0 to disable
+    bool complete_async_write(); // waits for the write in flight, if any. retries it synchronously on failure
+    u32 get_submitted_writes(); // the writes submitted so far
+    u32 get_completed_writes(); // the writes completed so far, always in submission order
+#endif
+
+#if ENABLE_FS_FREE_MAP
+    void use_free_map(bool use); // when false, cluster allocation goes back to scanning the FAT. meant for benchmarking
+    u32 find_free_cluster(); // the cluster the next allocation would pick, without allocating it. meant for benchmarking
+#endif
+
+#if ENABLE_FS_SESSION_INDEX
+    void use_session_index(bool use); // when false, sessions are numbered by scanning the root directory. meant for benchmarking
+#endif
+bool new_session(); // the files opened from now on go to a new session directory. the files already open stay where they are
+
+bool fopen(FILE* stream, const char* filename, char mode, bool root = false, u32 reserve_mb = 0); // support for 'r', 'w' and 'a' only. 'w' creates any directory needed for the given path. 'a' is like 'w' but seeks at the end of the file before writing.
+                                                                                                // reserve_mb is a hint : when writing, that much contiguous space is reserved past the end of the file, and the unused part is released by fclose
 int fclose(FILE* stream);
 size_t fread(void* ptr, size_t size, size_t count, FILE* stream);
 size_t fwrite(const void* ptr, size_t size, size_t count, FILE* stream);
+#if ENABLE_FS_ZERO_COPY
+    // writes without copying, for serializers encoding straight into the write buffer of the file. reserve returns where the next size bytes
+    // of the file go, or 0 if they would not fit contiguously in the current buffer : the caller then builds them elsewhere and uses fwrite.
+    // commit appends the first used bytes of the reservation to the file, used <= size. nothing else may write to the file in between
+    u8* reserve(FILE* stream, u32 size);
+    size_t commit(FILE* stream, u32 used);
+#endif
 size_t fprintf(FILE* stream, const char *fmt, ...);
 int fflush(FILE* stream, bool blocking = false); // if blocking set to true, this call BLOCKS until flush is done, be cautious
 
 class file_mgr
 {
 public:
-    file_mgr(const char* filename, char mode) : _filename(filename), _mode(mode)
+    file_mgr(const char* filename, char mode, u32 reserve_mb = 0) : _filename(filename), _mode(mode), _reserve_mb(reserve_mb)
     {
         _stream.fileinfo.volinfo = 0;
     }
     FILE* get_stream()
     {
         if (0 == _stream.fileinfo.volinfo)
-            if (!fopen(&_stream, _filename, _mode))
+            if (!fopen(&_stream, _filename, _mode, false, _reserve_mb))
                 return 0;
         return &_stream;
     }
@@ -68,6 +112,7 @@ private:
     FILE _stream;
     const char* _filename;
     char _mode;
+    u32 _reserve_mb;
 };
 
 }
\ No newline at end of file
@@ -25,10 +25,10 @@ namespace fs
     #endif
     
 
-    class queue : public base_sink<queue, msg::src::fs_queue, 4>
+    class queue : public base_sink<queue, msg::src::fs_queue>
     {
     public:
-        queue() : running(false), file_system_mutex(0), block_buf(0), working(false), was_full(false) {}
+        queue() : running(false), file_system_mutex(0), block_buf(0), working(false), write_depth(FS_QUEUE_WRITE_DEPTH), first_held(0), held_count(0), was_full(false) {}
 
         void init()
         {
@@ -57,6 +57,18 @@ namespace fs
             return running;
         }
 
+        // how many written blocks may be held back while their writes complete, the one in flight included. 1 waits for each write
+        // before taking the next block, 2 is enough to overlap the transfer of a block with the work on the next one.
+        void set_write_depth(u32 depth)
+        {
+            write_depth = (depth < 1) ? 1 : (depth > write_block_count / 2) ? write_block_count / 2 : depth;
+        }
+
+        bool is_idle() // nothing queued, and every write has completed
+        {
+            return 0 == queued_writes.occupied_space() && !working && 0 == held_count;
+        }
+
         void enqueue_write(FILE* file, u32 size) // intended to be run from the fs-using task
         {
             if (file->write_buf && size)
@@ -66,6 +78,7 @@ namespace fs
                 node.file = file;
                 node.size = size;
                 node.block_ptr = file->write_buf;
+                node.op = operation::write;
                 bool waited = queued_writes.write(node);
                 if (waited && !was_full)
                 {
@@ -88,6 +101,17 @@ namespace fs
             file->write_buf = reinterpret_cast<u8*>(ptr);
         }
 
+        void enqueue_sync(FILE* file) // writes back the metadata of the file once all the blocks queued before are written
+        {
+            enqueue_operation(file, operation::sync);
+        }
+
+        void enqueue_close(FILE* file) // completes fclose once all the blocks queued before are written, and frees the block of the file
+        {
+            enqueue_operation(file, operation::close, reinterpret_cast<block*>(file->write_buf));
+            file->write_buf = 0;
+        }
+
         static void static_thread(void* argument)
         {
             get_fs_queue().thread();
@@ -125,6 +149,37 @@ namespace fs
 
             // be sure to write all outstanding blocks before ending the thread
             write_block_queued_event();
+            running = false; // fclose completes the files itself from now on
+        }
+
+        // blocks are given back to the free list once every write submitted up to their own has completed
+        void release_blocks(bool wait)
+        {
+            if (wait && held_count)
+            {
+                ctl_mutex_lock(file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+                    complete_async_write();
+                ctl_mutex_unlock(file_system_mutex);
+            }
+
+            u32 completed = get_completed_writes();
+            while (held_count && static_cast<s32>(completed - held[first_held].ticket) >= 0)
+            {
+                free_blocks.write(held[first_held].ptr);
+                first_held = (first_held + 1) % write_block_count;
+                --held_count;
+            }
+        }
+
+        void hold_block(block* ptr, u32 ticket)
+        {
+            held[(first_held + held_count) % write_block_count].ptr = ptr;
+            held[(first_held + held_count) % write_block_count].ticket = ticket;
+            ++held_count;
+
+            release_blocks(false);
+            if (held_count >= write_depth)
+                release_blocks(true);
         }
 
         void write_block_queued_event()
@@ -134,17 +189,36 @@ namespace fs
 
             while (queued_writes.read(node))
             {
+                if (operation::write != node.op) // file operations have no data attached
+                {
+                    ctl_mutex_lock(file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+                        if (operation::sync == node.op)
+                            sync_file(node.file, true);
+                        else if (operation::close == node.op)
+                            finish_close(node.file);
+                    ctl_mutex_unlock(file_system_mutex);
+                    if (node.block_ptr) // the buffer the closed file was filling, never written
+                        free_blocks.write(reinterpret_cast<block*>(node.block_ptr));
+                    continue;
+                }
+
+                u32 ticket;
                 working = true; // simply used by the console to track when one block is being written
                 ctl_mutex_lock(file_system_mutex, CTL_TIMEOUT_INFINITE, 0);
+                    set_async_buffer(node.block_ptr, node.size); // the block is held until its writes complete, see hold_block
                     DFS_WriteFile(&node.file->fileinfo, block_buf, node.block_ptr, &successfully_written_bytes, node.size);
+                    set_async_buffer(0, 0);
+                    sync_file(node.file, false); // periodic write back of the metadata
+                    ticket = get_submitted_writes();
                 ctl_mutex_unlock(file_system_mutex);
                 working = false;
 
                 assert_fs_safe(successfully_written_bytes == node.size);
 
-                block* ptr = reinterpret_cast<block*>(node.block_ptr);
-                free_blocks.write(ptr);
+                hold_block(reinterpret_cast<block*>(node.block_ptr), ticket);
             }
+
+            release_blocks(true); // nothing else to overlap the last write with
         }
 
         static const CTL_EVENT_SET_t write_queue_mask = 1 << 0;
@@ -158,17 +232,51 @@ namespace fs
 
         volatile bool working;
 
+        struct held_block
+        {
+            block* ptr;
+            u32 ticket; // the block is free once that many writes have completed
+        };
+        held_block held[write_block_count];
+        u32 write_depth;
+        u32 first_held;
+        volatile u32 held_count;
+
         async::multi_reader_blocking_queue<block*, write_block_count> free_blocks;
         bool was_empty;
 
+        struct operation
+        {
+            enum en
+            {
+                write = 0,
+                sync,
+                close,
+            };
+        };
+
         struct write_node
         {
             u8* block_ptr;
             u32 size;
             FILE* file; // pointer to the file - do not use the buffer stored in that file struct! it is the one currently in use. use block_ptr instead, it was saved before the swap.
+            operation::en op;
         };
+
+        void enqueue_operation(FILE* file, operation::en op, block* ptr = 0) // queues an operation on the file itself, performed in order with the writes
+        {
+            write_node node;
+            node.file = file;
+            node.size = 0;
+            node.block_ptr = reinterpret_cast<u8*>(ptr);
+            node.op = op;
+            queued_writes.write(node);
+        }
         async::multi_writer_blocking_queue<write_node, write_block_count> queued_writes;
         bool was_full;
+
+    public:
+        typedef no_observers observers; // the writes come through queued_writes, the messages only end the thread
     };
 }
 
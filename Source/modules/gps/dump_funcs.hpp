@@ -6,6 +6,27 @@
 #include "Protocols/generic_protocol.hpp"
 #include "Protocols/onboard_logs/onboard_logs.hpp"
 
+#if ENABLE_FS_ZERO_COPY
+// where to build a packet of at most max_payload_len bytes of payload : straight into the write buffer of the file when it has
+// room left for it, otherwise in the linear buffer of the protocol
+template <typename protocol_type>
+u8* begin_packet(protocol_type& protocol, u32 max_payload_len, fs::FILE* stream)
+{
+    u8* packet = fs::reserve(stream, protocol.packet_len(max_payload_len));
+    return packet ? packet : protocol.get_linear_buffer();
+}
+
+template <typename protocol_type>
+void end_packet(protocol_type& protocol, u8* packet, u32 payload_len, fs::FILE* stream)
+{
+    protocol.prepare_packet(packet, payload_len);
+    if (protocol.get_linear_buffer() == packet)
+        fs::fwrite(packet, protocol.get_packet_len(packet), 1, stream);
+    else
+        fs::commit(stream, protocol.get_packet_len(packet));
+}
+#endif
+
 template <typename protocol_type>
 void gnss_navdata_dump(gnss_navdata& gd, protocol_type& protocol, fs::FILE* stream)
 {
@@ -86,7 +107,15 @@ void gnss_rawdata_dump(gnss_rawdata& gd, protocol_type& protocol, fs::FILE* stre
     if (!stream)
         return;
 
-    generic_protocol::onboard_logs::gnss_raw_data_dump_v0* msg_ptr = reinterpret_cast<generic_protocol::onboard_logs::gnss_raw_data_dump_v0*>(protocol.get_payload());
+    #if ENABLE_FS_ZERO_COPY
+        static const u32 max_payload_len = sizeof(generic_protocol::onboard_logs::gnss_raw_data_dump_v0) + 16 * sizeof(generic_protocol::onboard_logs::general_prs);
+        u8* packet = begin_packet(protocol, max_payload_len, stream);
+        u8* payload = protocol.get_payload(packet);
+    #else
+        u8* payload = protocol.get_payload();
+    #endif
+
+    generic_protocol::onboard_logs::gnss_raw_data_dump_v0* msg_ptr = reinterpret_cast<generic_protocol::onboard_logs::gnss_raw_data_dump_v0*>(payload);
     msg_ptr->init_msg_type();
 
     msg_ptr->tow = gd.tow;
@@ -95,7 +124,7 @@ void gnss_rawdata_dump(gnss_rawdata& gd, protocol_type& protocol, fs::FILE* stre
 
     u32 size_until_now = sizeof(generic_protocol::onboard_logs::gnss_raw_data_dump_v0);
 
-    generic_protocol::onboard_logs::general_prs* prs_ptr = reinterpret_cast<generic_protocol::onboard_logs::general_prs*>(protocol.get_payload() + size_until_now);
+    generic_protocol::onboard_logs::general_prs* prs_ptr = reinterpret_cast<generic_protocol::onboard_logs::general_prs*>(payload + size_until_now);
     for (u8 i = 0; i < 16; ++i)
     {
         prs_ptr->qli = gd.meas[i].qli;
@@ -110,12 +139,16 @@ void gnss_rawdata_dump(gnss_rawdata& gd, protocol_type& protocol, fs::FILE* stre
         }
         else
             size_until_now += sizeof(prs_ptr->qli);
-        prs_ptr = reinterpret_cast<generic_protocol::onboard_logs::general_prs*>(protocol.get_payload() + size_until_now);
+        prs_ptr = reinterpret_cast<generic_protocol::onboard_logs::general_prs*>(payload + size_until_now);
     }
 
-    protocol.prepare_packet(size_until_now);
+    #if ENABLE_FS_ZERO_COPY
+        end_packet(protocol, packet, size_until_now, stream);
+    #else
+        protocol.prepare_packet(size_until_now);
 
-    fs::fwrite(protocol.get_linear_buffer(), protocol.get_packet_len(), 1, stream);
+        fs::fwrite(protocol.get_linear_buffer(), protocol.get_packet_len(), 1, stream);
+    #endif
 }
 
 template <typename protocol_type>
@@ -124,7 +157,15 @@ void raw_base_dump(basedata& bd, protocol_type& protocol, fs::FILE* stream)
     if (!bd.datavalid || !stream)
         return;
 
-    generic_protocol::onboard_logs::base_data_dump_v0* msg_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_data_dump_v0*>(protocol.get_payload());
+    #if ENABLE_FS_ZERO_COPY
+        static const u32 max_payload_len = sizeof(generic_protocol::onboard_logs::base_data_dump_v0) + 16 * sizeof(generic_protocol::onboard_logs::base_measurement) + sizeof(generic_protocol::onboard_logs::base_position);
+        u8* packet = begin_packet(protocol, max_payload_len, stream);
+        u8* payload = protocol.get_payload(packet);
+    #else
+        u8* payload = protocol.get_payload();
+    #endif
+
+    generic_protocol::onboard_logs::base_data_dump_v0* msg_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_data_dump_v0*>(payload);
     msg_ptr->init_msg_type();
 
     msg_ptr->tow = bd.tow;
@@ -134,7 +175,7 @@ void raw_base_dump(basedata& bd, protocol_type& protocol, fs::FILE* stream)
 
     u32 size_until_now = sizeof(generic_protocol::onboard_logs::base_data_dump_v0);
 
-    generic_protocol::onboard_logs::base_measurement* meas_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_measurement*>(protocol.get_payload() + size_until_now);
+    generic_protocol::onboard_logs::base_measurement* meas_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_measurement*>(payload + size_until_now);
     for (u8 i = 0; i < 16; ++i)
     {
         meas_ptr->prn = bd.prn[i];
@@ -153,10 +194,10 @@ void raw_base_dump(basedata& bd, protocol_type& protocol, fs::FILE* stream)
         }
         else
             size_until_now += sizeof(meas_ptr->prs.qli);
-        meas_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_measurement*>(protocol.get_payload() + size_until_now);
+        meas_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_measurement*>(payload + size_until_now);
     }
 
-    generic_protocol::onboard_logs::base_position* pos_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_position*>(protocol.get_payload() + size_until_now);
+    generic_protocol::onboard_logs::base_position* pos_ptr = reinterpret_cast<generic_protocol::onboard_logs::base_position*>(payload + size_until_now);
     pos_ptr->pvalid = bd.pvalid;
     if (3 == bd.pvalid)
     {
@@ -173,9 +214,13 @@ void raw_base_dump(basedata& bd, protocol_type& protocol, fs::FILE* stream)
     else
         size_until_now += sizeof(pos_ptr->pvalid);
 
-    protocol.prepare_packet(size_until_now);
+    #if ENABLE_FS_ZERO_COPY
+        end_packet(protocol, packet, size_until_now, stream);
+    #else
+        protocol.prepare_packet(size_until_now);
 
-    fs::fwrite(protocol.get_linear_buffer(), protocol.get_packet_len(), 1, stream);
+        fs::fwrite(protocol.get_linear_buffer(), protocol.get_packet_len(), 1, stream);
+    #endif
 }
 
 template <typename protocol_type>
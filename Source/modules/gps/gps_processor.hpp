@@ -37,7 +37,6 @@ namespace gps {
 #endif
 
 #if ENABLE_BASE_PROCESSOR
-    static const u32 method_observer_count = 6;
     static const gnss_com::dyn_mode::en gnss_dynamic_mode = gnss_com::dyn_mode::stationary;
 #endif
 #if ENABLE_ROVER_PROCESSOR
@@ -63,11 +62,10 @@ namespace gps {
         }
     };
     
-    static const u32 method_observer_count = 9;
     static const gnss_com::dyn_mode::en gnss_dynamic_mode = gnss_com::dyn_mode::pedestrian;
 #endif
 
-class processor : public base_sink<processor, msg::src::gps_processor, method_observer_count>
+class processor : public base_sink<processor, msg::src::gps_processor>
 {
 public:
     processor() : gnss_com_ctrl(get_hf_clock()), rf_ctrl(get_hf_clock())
@@ -85,11 +83,11 @@ public:
                   , rover_pda_link(gps_ctrl, gnss_com_ctrl, rf_ctrl)
             #endif
             #if ENABLE_RAW_LOGGING
-                  , raw_log_file("raw_log.dat", 'w')
+                  , raw_log_file("raw_log.dat", 'w', FS_LOG_RESERVE_MB)
             #endif
             #if ENABLE_GPS_UART_LOGGING
                   , gps_uart_logger(get_gps_uart_io(), gps_uart_log_file)
-                  , gps_uart_log_file("uart_log.dat", 'w')
+                  , gps_uart_log_file("uart_log.dat", 'w', FS_LOG_RESERVE_MB)
             #endif
     {}
 
@@ -125,28 +123,12 @@ public:
         get_int_ctrl().enable_interrupt(lpc3230::interrupt::id::zigbee_not_cts);
       #endif
 
-        set_method_observer(msg::id::zigbee_not_cts, &processor::zigbee_not_cts_event);
-        set_method_observer(msg::id::proximity_detected, &processor::proximity_detected_event);
-        set_method_observer(msg::id::battery_level, &processor::battery_level_event);
-        set_method_observer(msg::id::file_system_write_queue_full, &processor::file_system_write_queue_full_event);
-        set_method_observer(msg::id::file_system_no_more_free, &processor::file_system_no_more_free_event);
-        set_method_observer(msg::id::serial_number, &processor::serial_number_event);
-      #if ENABLE_ROVER_PROCESSOR
-        set_method_observer(msg::id::battery_info, &processor::battery_info_event);
-        set_method_observer(msg::id::charger_info, &processor::charger_info_event);
-        set_method_observer(msg::id::auxctl_info, &processor::auxctl_info_event);
-      #endif
-
-        subscribe_to_global_message(msg::id::proximity_detected);
-        subscribe_to_global_message(msg::id::battery_level);
-        subscribe_to_global_message(msg::id::file_system_write_queue_full);
-        subscribe_to_global_message(msg::id::file_system_no_more_free);
-        subscribe_to_global_message(msg::id::serial_number);
-      #if ENABLE_ROVER_PROCESSOR
-        subscribe_to_global_message(msg::id::battery_info);
-        subscribe_to_global_message(msg::id::charger_info);
-        subscribe_to_global_message(msg::id::auxctl_info);
-      #endif
+        subscribe_to_global_message<msg::id::proximity_detected>();
+        subscribe_to_global_message<msg::id::battery_level>();
+        subscribe_to_global_message<msg::id::file_system_write_queue_full>();
+        subscribe_to_global_message<msg::id::file_system_no_more_free>();
+        subscribe_to_global_message<msg::id::message_overflow>();
+        // serial_number, battery_info, charger_info and auxctl_info are replies to our own requests, they come to us only
     }
 
     void get_and_init_event(CTL_EVENT_SET_t*& event, CTL_EVENT_SET_t& gps_receive_flag, CTL_EVENT_SET_t& gps_error_flag
@@ -193,11 +175,11 @@ public:
         static void static_time_pulse_isr()
         {
             get_rt_clock().system_time_snapshot();
-            get_central().send_message(msg::src::aux, msg::id::timepulse);
+            get_central().notify(msg::src::aux, msg::id::timepulse);
         }
     #endif
     #if RF_LINK_ZIGBEE
-        static void static_zigbee_cts_isr()       { get_central().send_message(msg::src::gps_processor, msg::id::zigbee_not_cts); }
+        static void static_zigbee_cts_isr()       { get_central().notify(msg::src::gps_processor, msg::id::zigbee_not_cts); }
     #endif
     static void static_thread(void* argument) { get_gps_processor().run(); }
 
@@ -206,17 +188,12 @@ private:
     {
         CTL_EVENT_SET_t event_received;
 
-        // request the battery level periodically
-        msg::payload::enqueue_time_event batt_request;
-        batt_request.message = msg::id::battery_level_request;
-        batt_request.dest = msg::src::aux;
-        batt_request.type = msg::payload::time_event_types::repeating;
-        batt_request.next_time_ms = 0;
-        batt_request.period = 10000;
-        get_central().send_message(msg::src::time_queue, msg::id::enqueue_time_event, sizeof(batt_request), reinterpret_cast<u8*>(&batt_request));
+        // request the battery level periodically. the time_queue may still be busy with the other tasks starting, in which case try again
+        while (!get_central().schedule(msg::src::aux, msg::id::battery_level_request, 0, 10000, 1000))
+            ctl_timeout_wait(ctl_get_current_time() + 10);
 
         // request the board serial number ( == RF MAC address)
-        get_central().send_message(msg::src::aux, msg::id::serial_number_request);
+        get_central().request(msg::src::aux, msg::id::serial_number_request, msg::src::gps_processor, msg::aux_reply_timeout_ms);
 
         // ensure the files are created before we get into the loop as those operations can take some time
       #if ENABLE_RAW_LOGGING
@@ -385,15 +362,14 @@ private:
 
     void zigbee_not_cts_event(u32 len)
     {
-        debug::log(debug::error, "Short Range Radio (SRR) Socket NOT clear to send : please reduce the baud rate on this UART");
+        const msg::payload::notification& payload = current_payload<msg::payload::notification>(len);
+        debug::log(debug::error, "Short Range Radio (SRR) Socket NOT clear to send (%d times) : please reduce the baud rate on this UART", payload.count);
     }
 
     void proximity_detected_event(u32 len)
     {
       #if ENABLE_BASE_PROCESSOR
-        msg::payload::proximity_detected payload;
-        assert(sizeof(payload) == len);
-        read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
+        const msg::payload::proximity_detected& payload = current_payload<msg::payload::proximity_detected>(len);
         detected_rover_address = payload.source_address;
         rf_ctrl.tx_proxdetpckt(payload.tow, payload.time_valid, detected_rover_address);
         debug::log(debug::message, "Proximity detected on Base through RFID, event was sent through radio link");
@@ -433,37 +409,45 @@ private:
             message_dump(error_buffer, msg_len, log_protocol, raw_log_file.get_stream());
         #endif
     }
+
+    void message_overflow_event(u32 len)
+    {
+        const msg::payload::message_overflow& payload = current_payload<msg::payload::message_overflow>(len);
+        debug::log(debug::error, "Message queue %d overflowed sending message %d : outcome %d, %d lost", payload.queue, payload.message, payload.outcome, payload.lost);
+        #if ENABLE_GPS_ERROR_LOGGING
+            u32 msg_len = debug::log_to_string(error_buffer, debug::error, "Message queue %d overflowed sending message %d : outcome %d, %d lost", payload.queue, payload.message, payload.outcome, payload.lost);
+            message_dump(error_buffer, msg_len, log_protocol, raw_log_file.get_stream());
+        #endif
+    }
     
+    void request_timeout_event(u32 len)
+    {
+        const msg::payload::request_timeout& payload = current_payload<msg::payload::request_timeout>(len);
+        debug::log(debug::warning, "No reply to message %d from the auxiliary controller", payload.request);
+    }
+
     void serial_number_event(u32 len)
     {
-        msg::payload::serial_number payload;
-        assert(sizeof(payload) == len);
-        read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
+        const msg::payload::serial_number& payload = current_payload<msg::payload::serial_number>(len);
         rf_ctrl.set_mac_addr(payload.serial_number);
     }
 
   #if ENABLE_ROVER_PROCESSOR
     void battery_info_event(u32 len)
     {
-        msg::payload::battery_info payload;
-        assert(sizeof(payload) == len);
-        read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
+        const msg::payload::battery_info& payload = current_payload<msg::payload::battery_info>(len);
         rover_pda_link.send_battery_info_v0(payload);
     }
 
     void charger_info_event(u32 len)
     {
-        msg::payload::charger_info payload;
-        assert(sizeof(payload) == len);
-        read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
+        const msg::payload::charger_info& payload = current_payload<msg::payload::charger_info>(len);
         rover_pda_link.send_charger_info_v0(payload);
     }
 
     void auxctl_info_event(u32 len)
     {
-        msg::payload::auxctl_info payload;
-        assert(sizeof(payload) == len);
-        read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
+        const msg::payload::auxctl_info& payload = current_payload<msg::payload::auxctl_info>(len);
         rover_pda_link.send_auxctl_info_v0(payload);
     }
 
@@ -478,6 +462,24 @@ private:
       #endif
   #endif
 
+public:
+  #if ENABLE_ROVER_PROCESSOR
+    typedef on<msg::id::battery_info, &processor::battery_info_event,
+            on<msg::id::charger_info, &processor::charger_info_event,
+            on<msg::id::auxctl_info, &processor::auxctl_info_event> > > rover_observers;
+  #else
+    typedef no_observers rover_observers;
+  #endif
+    typedef on<msg::id::zigbee_not_cts, &processor::zigbee_not_cts_event,
+            on<msg::id::proximity_detected, &processor::proximity_detected_event,
+            on<msg::id::battery_level, &processor::battery_level_event,
+            on<msg::id::file_system_write_queue_full, &processor::file_system_write_queue_full_event,
+            on<msg::id::file_system_no_more_free, &processor::file_system_no_more_free_event,
+            on<msg::id::message_overflow, &processor::message_overflow_event,
+            on<msg::id::request_timeout, &processor::request_timeout_event,
+            on<msg::id::serial_number, &processor::serial_number_event, rover_observers> > > > > > > > observers;
+
+private:
     CTL_EVENT_SET_t gnss_receive_event;
     static const CTL_EVENT_SET_t gps_receive_mask = 1 << 0;
     static const CTL_EVENT_SET_t gps_error_mask = 1 << 1;
@@ -50,7 +50,7 @@ class pda_link
 public:
     pda_link(::rover::ctrl& rover_controller, gnss_com::ctrl& gnss_controller, rf_stack::high_level& rf_hl_stack) : rover_ctrl(rover_controller), gnss_ctrl(gnss_controller), rf_stack(rf_hl_stack), rover_batt(0), rover_status(0)
         #if ENABLE_ROVER_OUTPUT_LOGGING
-            , output_log_file("rover.dat", 'w')
+            , output_log_file("rover.dat", 'w', FS_LOG_RESERVE_MB)
         #endif
         , selected_port(0), console_event(0), console_mask(0)
     {
@@ -261,13 +261,13 @@ private:
             send_sys_ref_pos_v0();
             break;
         case generic_protocol::universe::battery_info_v0:
-            get_central().send_message(msg::src::aux, msg::id::battery_info_request);
+            get_central().request(msg::src::aux, msg::id::battery_info_request, msg::src::gps_processor, msg::aux_reply_timeout_ms);
             break;
         case generic_protocol::universe::charger_info_v0:
-            get_central().send_message(msg::src::aux, msg::id::charger_info_request);
+            get_central().request(msg::src::aux, msg::id::charger_info_request, msg::src::gps_processor, msg::aux_reply_timeout_ms);
             break;
         case generic_protocol::universe::auxctl_info_v0:
-            get_central().send_message(msg::src::aux, msg::id::auxctl_info_request);
+            get_central().request(msg::src::aux, msg::id::auxctl_info_request, msg::src::gps_processor, msg::aux_reply_timeout_ms);
             break;
         default:
             break;
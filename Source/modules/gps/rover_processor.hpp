@@ -38,7 +38,7 @@ struct debug_rf_status
 };
 
 class processor;
-typedef base_sink<processor, msg::src::gps_processor, 9> rover_sink;
+typedef base_sink<processor, msg::src::gps_processor> rover_sink;
 
 class proximity_detector : public msg_handler::proxdet
 {
@@ -100,23 +100,13 @@ public:
         SIC2_RSR |= (1<<22); // hard patch to guard against this interrupt triggering when we program the controller
         get_int_ctrl().enable_interrupt(lpc3230::interrupt::id::zigbee_not_cts);
 
-        set_method_observer(msg::id::zigbee_not_cts, &processor::zigbee_not_cts_event);
-        set_method_observer(msg::id::proximity_detected, &processor::proximity_detected_event);
-        set_method_observer(msg::id::battery_level, &processor::battery_level_event);
-        set_method_observer(msg::id::serial_number, &processor::serial_number_event);
-        set_method_observer(msg::id::file_system_write_queue_full, &processor::file_system_write_queue_full_event);
-        set_method_observer(msg::id::file_system_no_more_free, &processor::file_system_no_more_free_event);
-        set_method_observer(msg::id::battery_info, &processor::battery_info_event);
-        set_method_observer(msg::id::charger_info, &processor::charger_info_event);
-        set_method_observer(msg::id::auxctl_info, &processor::auxctl_info_event);
-
-        subscribe_to_global_message(msg::id::battery_level);
-        subscribe_to_global_message(msg::id::serial_number);
-        subscribe_to_global_message(msg::id::file_system_write_queue_full);
-        subscribe_to_global_message(msg::id::file_system_no_more_free);
-        subscribe_to_global_message(msg::id::battery_info);
-        subscribe_to_global_message(msg::id::charger_info);
-        subscribe_to_global_message(msg::id::auxctl_info);
+        subscribe_to_global_message<msg::id::battery_level>();
+        subscribe_to_global_message<msg::id::serial_number>();
+        subscribe_to_global_message<msg::id::file_system_write_queue_full>();
+        subscribe_to_global_message<msg::id::file_system_no_more_free>();
+        subscribe_to_global_message<msg::id::battery_info>();
+        subscribe_to_global_message<msg::id::charger_info>();
+        subscribe_to_global_message<msg::id::auxctl_info>();
     }
 
     void get_and_init_event(CTL_EVENT_SET_t*& event, CTL_EVENT_SET_t& gnss_receive_flag, CTL_EVENT_SET_t& gnss_error_flag, CTL_EVENT_SET_t& rf_flag, CTL_EVENT_SET_t& rf_error_flag, CTL_EVENT_SET_t& pda_flag)
@@ -144,10 +134,10 @@ public:
         static void static_isr()
         {
             get_rt_clock().system_time_snapshot();
-            get_central().send_message(msg::src::aux, msg::id::timepulse);
+            get_central().notify(msg::src::aux, msg::id::timepulse);
         }
     #endif
-    static void static_zigbee_cts_isr()       { get_central().send_message(msg::src::gps_processor, msg::id::zigbee_not_cts); }
+    static void static_zigbee_cts_isr()       { get_central().notify(msg::src::gps_processor, msg::id::zigbee_not_cts); }
     static void static_thread(void* argument) { get_rover_processor().run(); }
 
 private:
@@ -155,14 +145,9 @@ private:
     {
         CTL_EVENT_SET_t event_received;
 
-        // request the battery level periodically
-        msg::payload::enqueue_time_event batt_request;
-        batt_request.message = msg::id::battery_level_request;
-        batt_request.dest = msg::src::aux;
-        batt_request.type = msg::payload::time_event_types::repeating;
-        batt_request.next_time_ms = 0;
-        batt_request.period = 10000;
-        get_central().send_message(msg::src::time_queue, msg::id::enqueue_time_event, sizeof(batt_request), reinterpret_cast<u8*>(&batt_request));
+        // request the battery level periodically. the time_queue may still be busy with the other tasks starting, in which case try again
+        while (!get_central().schedule(msg::src::aux, msg::id::battery_level_request, 0, 10000, 1000))
+            ctl_timeout_wait(ctl_get_current_time() + 10);
 
         // request the board serial number ( == RF MAC address)
         get_central().send_message(msg::src::aux, msg::id::serial_number_request);
@@ -412,6 +397,18 @@ private:
         }
     #endif
 
+public:
+    typedef on<msg::id::zigbee_not_cts, &processor::zigbee_not_cts_event,
+            on<msg::id::proximity_detected, &processor::proximity_detected_event,
+            on<msg::id::battery_level, &processor::battery_level_event,
+            on<msg::id::serial_number, &processor::serial_number_event,
+            on<msg::id::file_system_write_queue_full, &processor::file_system_write_queue_full_event,
+            on<msg::id::file_system_no_more_free, &processor::file_system_no_more_free_event,
+            on<msg::id::battery_info, &processor::battery_info_event,
+            on<msg::id::charger_info, &processor::charger_info_event,
+            on<msg::id::auxctl_info, &processor::auxctl_info_event> > > > > > > > > observers;
+
+private:
     CTL_EVENT_SET_t gnss_receive_event;
     static const CTL_EVENT_SET_t gnss_receive_mask = 1 << 0;
     static const CTL_EVENT_SET_t gnss_error_mask = 1 << 1;
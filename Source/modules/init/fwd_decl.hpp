@@ -93,6 +93,10 @@ namespace msg
 {
     class central;
 }
+namespace async
+{
+    class worker_pool;
+}
 namespace simulator
 {
     class rover;
@@ -106,6 +110,8 @@ namespace benchmarks
         class controller;
     }
     class sd;
+    class messages;
+    class time_events;
 }
 namespace debug
 {
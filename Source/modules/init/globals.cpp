@@ -8,6 +8,7 @@
 #include "modules/time_queue/time_queue.hpp"
 #include "modules/aux_ctrl/aux_ctrl.hpp"
 #include "modules/async/messages.hpp"
+#include "modules/async/worker_pool.hpp"
 #include "modules/gps/gps_processor.hpp"
 #include "modules/clock/rt_clock.hpp"
 #include "modules/file_system/file_system_queue.hpp"
@@ -16,6 +17,8 @@
 #include "simulator/math_benchmark.hpp"
 #include "simulator/gps_benchmark.hpp"
 #include "simulator/sd_benchmark.hpp"
+#include "simulator/message_benchmark.hpp"
+#include "simulator/time_queue_benchmark.hpp"
 #include "HighFreqClock/hf_clock.hpp"
 
 clock::rt_clock rt_clk;
@@ -138,6 +141,11 @@ time_queue::queue& get_time_queue() { return time_q; }
 msg::central central;
 msg::central& get_central() { return central; }
 
+#if ENABLE_WORKER_POOL
+    async::worker_pool worker_pool;
+    async::worker_pool& get_worker_pool() { return worker_pool; }
+#endif
+
 #if ENABLE_ROVER_SIMULATOR
     simulator::rover rover_sim;
     simulator::rover& get_rover_sim() { return rover_sim; }
@@ -158,4 +166,14 @@ msg::central& get_central() { return central; }
 #if ENABLE_SD_BENCHMARKS
     benchmarks::sd sd_bench;
     benchmarks::sd& get_sd_bench() { return sd_bench; }
+#endif
+
+#if ENABLE_MESSAGE_BENCHMARKS
+    benchmarks::messages message_bench;
+    benchmarks::messages& get_message_bench() { return message_bench; }
+#endif
+
+#if ENABLE_TIME_QUEUE_BENCHMARKS
+    benchmarks::time_events time_queue_bench;
+    benchmarks::time_events& get_time_queue_bench() { return time_queue_bench; }
 #endif
\ No newline at end of file
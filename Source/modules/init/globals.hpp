@@ -89,6 +89,10 @@ time_queue::queue& get_time_queue();
 
 msg::central& get_central();
 
+#if ENABLE_WORKER_POOL
+    async::worker_pool& get_worker_pool();
+#endif
+
 #if ENABLE_ROVER_SIMULATOR
     simulator::rover& get_rover_sim();
 #endif
@@ -104,4 +108,12 @@ msg::central& get_central();
 
 #if ENABLE_SD_BENCHMARKS
     benchmarks::sd& get_sd_bench();
+#endif
+
+#if ENABLE_MESSAGE_BENCHMARKS
+    benchmarks::messages& get_message_bench();
+#endif
+
+#if ENABLE_TIME_QUEUE_BENCHMARKS
+    benchmarks::time_events& get_time_queue_bench();
 #endif
\ No newline at end of file
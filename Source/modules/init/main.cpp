@@ -12,6 +12,7 @@
 #include "modules/time_queue/time_queue.hpp"
 #include "modules/aux_ctrl/aux_ctrl.hpp"
 #include "modules/async/messages.hpp"
+#include "modules/async/worker_pool.hpp"
 #include "modules/file_system/file_system.hpp"
 #include "modules/file_system/file_system_queue.hpp"
 #include "modules/file_system/fat/dosfs.hpp"
@@ -24,6 +25,8 @@
 #include "simulator/math_benchmark.hpp"
 #include "simulator/gps_benchmark.hpp"
 #include "simulator/sd_benchmark.hpp"
+#include "simulator/message_benchmark.hpp"
+#include "simulator/time_queue_benchmark.hpp"
 
 using namespace lpc3230;
 
@@ -99,6 +102,14 @@ void wait_shutdown()
         benchmarks::sd::static_thread(0); // this benchmark could also be run as a thread for further debugging
         profile::controller::report();
     #endif
+    #if ENABLE_MESSAGE_BENCHMARKS
+        benchmarks::messages::static_thread(0);
+        profile::controller::report();
+    #endif
+    #if ENABLE_TIME_QUEUE_BENCHMARKS
+        benchmarks::time_events::static_thread(0);
+        profile::controller::report();
+    #endif
 
     bool shutdown = false;
     while (!shutdown) // message loop : waits for only one message, the shutdown_request
@@ -158,6 +169,10 @@ int main()
         ctl_task_run(&bluetooth_task, thread_priorities::bluetooth, bluetooth::stack<lpc3230::high_speed_uart::uart<uart_ids::bluetooth>, irq_priorities::bluetooth>::static_bluetooth_thread, 0, "bluetooth", sizeof(bluetooth_stack) / sizeof(u32), (unsigned int*)bluetooth_stack, 0); // create the bluetooth_task
     #endif
 
+    #if ENABLE_WORKER_POOL
+        get_worker_pool().start(thread_priorities::worker); // creates the worker tasks
+    #endif
+
     #if ENABLE_CONSOLE
         memset(console_stack, 0xbe, sizeof(console_stack)); // init the stack to a recognizable value
         ctl_task_run(&console_task, thread_priorities::console, console::simple::static_thread, 0, "console", sizeof(console_stack) / sizeof(u32), (unsigned int*)console_stack, 0); // create the console thread
@@ -182,6 +197,10 @@ int main()
         task_join(console_task);
     #endif
 
+    #if ENABLE_WORKER_POOL
+        get_worker_pool().stop(); // the jobs may still log or write files
+    #endif
+
     debug::stop(); // flushes the profile.txt file if it was used
 
     #if ENABLE_FS_QUEUE
@@ -74,6 +74,7 @@ namespace thread_priorities
     {
         idle = 0, // lowest
         main,
+        worker, // long computations, below every time critical task
         time_queue,
         fs_queue,
         console,
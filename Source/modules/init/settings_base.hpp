@@ -46,18 +46,52 @@
 
 #define ENABLE_UART_STATS 1
 
+#define ENABLE_LOCK_FREE_MESSAGES 1 // tasks post to the msg::central queues by claiming their space with interrupts briefly disabled, rather than holding a mutex for the whole copy
+#define ENABLE_MESSAGE_STATS 0 // stamps every message with its commit time for per queue and per id latencies, tracks queue high-water marks and drops. for diagnosis : the message headers double to 16 bytes, so the msg::queues hold about half as many messages
+#define ENABLE_WORKER_POOL 0 // a few tasks, created once, running long computations off the time critical tasks, see async::worker_pool and async::delayed_result. nothing submits to it yet, its stacks would only take internal RAM
+#define ENABLE_PROFILE_TRACE 0 // with CTL_PROFILING, the profiler also records each sample begin and end, task switch and interrupt in a ring : 'ptrace' dumps it to the SD, host/trace_to_json.cpp makes a timeline of it
+    #if DDR_LOADER
+        #define PROFILE_TRACE_RECORDS (64 * 1024) // 8 bytes each, a power of two. the oldest records are overwritten. the ring is in .non_init, in DDR here
+    #else
+        #define PROFILE_TRACE_RECORDS (2 * 1024) // .non_init is in the internal RAM for the other placements, 16 KB of it
+    #endif
+#define ENABLE_PROFILE_HISTOGRAMS 1 // with CTL_PROFILING, the run time of each sample completion is counted in log-scale buckets, for the percentiles of the 'prof' report. 256 bytes per sample
+
 #define ENABLE_SD_DMA 1 // enable direct memory access in the SD driver : transfers do not use the CPU. but also more complex. if you notice SD bugs, disable this to diagnose.
 #define FORCE_SD_DMA_BUFFER_STATIC_RAM 0 // even if the build uses DDR, the buffer will be forced into static RAM for faster DMA access. cache sync instructions will be used.
 #define FORCE_SD_DMA_DISABLE_CACHE_COHERENCE 1 // set to 1 if your DMA buffers have been set over non-cached memory to improve DMA performance by not requiring cache coherence calls
 #define ENABLE_SD_STATS 1 // enables statistics tracking in the SD driver
 #define ENABLE_SD_CONSISTENCY 0 // all reads will be doubled and compared, all writes will be read back and compared. for debugging only, this is very slow...
 #define MAX_SD_WRITE_CONSECUTIVE_BLOCKS 8 // maximum amount of consecutive blocks supported on a single IO - should roughly correspond to the allocation size of the FAT32 format settings
+#define MAX_SD_READ_CONSECUTIVE_BLOCKS 32 // maximum amount of consecutive blocks read by a single multiple block command. reads of contiguous clusters are merged up to this size, which also sizes the read DMA buffer
 
 #define ENABLE_FS_QUEUE 1 // enables a separate thread to maintain a write queue in order to decouple the threads using files from the write latency
     #define FS_QUEUE_BLOCK_COUNT 16
+    #define FS_QUEUE_WRITE_DEPTH 2 // written blocks held back while their SD writes complete. 1 waits for each write, 2 overlaps a transfer with the work on the next block
 
 #define ENABLE_FS_CACHING 1 // enables the allocation of block caches to increase the performance of the filesystem
-    #define FS_CACHE_COUNT 32 // number of block buffers to allocate
+    #define FS_CACHE_COUNT 256 // number of block buffers to allocate
+    #define FS_CACHE_WAYS 4 // entries per set. FS_CACHE_COUNT / FS_CACHE_WAYS must be a power of two
+    #define FS_CACHE_WRITE_BACK 0 // single sector writes (directory entries, partial data sectors) stay in the cache until synced, evicted or FS_CACHE_FLUSH_INTERVAL_MS elapses
+    #define FS_CACHE_FLUSH_INTERVAL_MS 2000
+
+#define ENABLE_FS_FAT_CACHE 1 // write-back cache dedicated to the FAT sectors : cluster links reach the card before any directory entry refers to them, on flush, close, shutdown, eviction or after FS_FAT_CACHE_FLUSH_INTERVAL_MS
+    #define FS_FAT_CACHE_COUNT 8 // number of FAT sectors cached
+    #define FS_FAT_CACHE_FLUSH_INTERVAL_MS 2000 // a modified FAT sector is written back at most this long after the cache became dirty
+
+#define ENABLE_FS_FREE_MAP 1 // keeps a bitmap of the free clusters in RAM, built when the volume is mounted, so allocating a cluster does not scan the FAT
+    #define FS_FREE_MAP_CLUSTERS (512 * 1024) // clusters covered by the map (64 KB) : a 2 GB volume with 4 KB clusters. larger volumes fall back to the FAT scan
+
+#define ENABLE_FS_LAZY_DIRENT 1 // file sizes are written to the directory entries on flush, close, shutdown and periodically, rather than after every write. halves the SD operations of streamed logs
+    #define FS_DIRENT_UPDATE_INTERVAL_MS 5000 // the size recorded on the card lags the written data by at most this delay, should power be lost
+    #define FS_LAZY_DIRENT_FILE_COUNT 8 // number of files open for writing whose entries can be deferred at once. files opened past that count update their entry on every write
+
+#define ENABLE_FS_PREALLOCATION 1 // log files reserve contiguous clusters when opened, trimmed on close : no FAT updates while they grow, and multi-block writes can span clusters
+    #define FS_LOG_RESERVE_MB 16 // reservation made by each log file (raw, uart and rover output logs)
+
+#define ENABLE_FS_SESSION_INDEX 1 // session.idx records the last session directory and where its entry lies in the root : at boot, the next session is numbered and created without scanning the whole root
+
+#define ENABLE_FS_ZERO_COPY 1 // fs::reserve / fs::commit : the raw data serializers encode their packets straight into the file write buffer, rather than into the protocol buffer then copied by fwrite
 
 #define ENABLE_FS_STATS 1 // enables statistics tracking in the file system (caching stats mostly)
 #define FS_TIME_ZONE -4 // Montreal timezone. (May be defined as a float)
@@ -88,5 +122,11 @@
 // Enable the SD / Filesystem benchmarks, and consistency checkers : great for debugging the SD driver and FAT32 / fopen-fwrite-etc. libraries
 #define ENABLE_SD_BENCHMARKS 0
 
+// Enable the message benchmarks : contention between tasks posting to the same msg::central queue, lock-free against mutex
+#define ENABLE_MESSAGE_BENCHMARKS 0
+
+// Enable the time queue benchmarks : the time_queue's event heap against the sorted array it replaced, as the number of events grows
+#define ENABLE_TIME_QUEUE_BENCHMARKS 0
+
 // Exclude the geoid grids from current build
 #define EXCLUDE_GEOIDS 1
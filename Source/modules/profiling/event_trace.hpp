@@ -0,0 +1,138 @@
+#pragma once
+
+#include "armtastic/types.hpp"
+
+// the profiler's event trace : besides its sums, profile::controller records each sample begin and end, task switch and interrupt in a ring
+// buffer, overwriting the oldest records once full. the 'ptrace' console command dumps the ring to the SD, and host/trace_to_json.cpp
+// converts the dump to the chrome trace event format, to see the ordering and the interleaving of the tasks and interrupts on a timeline.
+// the file layout below is shared with the host converter, both sides being little endian.
+
+namespace profile {
+namespace trace {
+
+static const u32 file_magic = 0x43525450; // "PTRC"
+static const u32 file_version = 1;
+
+namespace record_type
+{
+    enum en
+    {
+        begin = 0, // of a task sample
+        end,
+        task_switch,
+        interrupt_begin,
+        interrupt_end,
+    };
+}
+
+struct record
+{
+    u32 time; // low word of the system time, see file_header::last_time
+    u8 type; // record_type
+    u8 task; // executing, or switched to for a task switch
+    u16 sample; // index in the profiler samples, or the task switched from for a task switch
+};
+
+// the dump : this header, then name_count name_entry, then record_count record, the oldest first
+struct file_header
+{
+    u32 magic;
+    u32 version;
+    u32 system_freq; // of the record times, in Hz
+    u32 samples_per_tasks; // the samples of a task are numbered from task * samples_per_tasks, the first one being the task itself
+    u32 task_count; // the interrupt samples are numbered from task_count * samples_per_tasks
+    u32 name_count;
+    u32 record_count;
+    u32 lost; // overwritten before the dump
+    u64 last_time; // full system time of the newest record, the earlier ones being less than 2^32 system units apart from the next
+};
+
+struct name_entry
+{
+    u16 sample;
+    u16 reserved;
+    char name[28]; // truncated, always terminated
+};
+
+}
+}
+
+#if defined(CTL_PROFILING) && ENABLE_PROFILE_TRACE
+
+#include "boost/static_assert.hpp"
+
+namespace profile {
+namespace trace {
+
+// the ring, appended to by the controller with interrupts disabled. a record is a few stores. its size depends on the placement, see PROFILE_TRACE_RECORDS
+class recorder
+{
+public:
+    static const u32 capacity = PROFILE_TRACE_RECORDS;
+    BOOST_STATIC_ASSERT(capacity && 0 == (capacity & (capacity - 1)));
+
+    static void init()
+    {
+        restart();
+        last_time = 0;
+    }
+
+    static void add(record_type::en type, u32 task, u32 sample, u64 time)
+    {
+        if (!recording)
+            return;
+        if (full)
+            ++lost;
+        record& r = records[next];
+        r.time = static_cast<u32>(time);
+        r.type = static_cast<u8>(type);
+        r.task = static_cast<u8>(task);
+        r.sample = static_cast<u16>(sample);
+        last_time = time;
+        next = (next + 1) & (capacity - 1);
+        if (0 == next)
+            full = true;
+    }
+
+    // stops the recording, so the ring can be written out as it is
+    static void pause() { recording = false; }
+
+    // starts anew, the ring emptied
+    static void restart()
+    {
+        int enabled = ctl_global_interrupts_set(0);
+            next = lost = 0;
+            full = false;
+            recording = true;
+        ctl_global_interrupts_set(enabled);
+    }
+
+    static u32 get_count() { return full ? capacity : next; }
+    static u32 get_lost() { return lost; }
+    static u64 get_last_time() { return last_time; }
+
+    // the records kept, the oldest first, in at most two runs
+    static const record* get_first_run(u32& count)
+    {
+        count = full ? capacity - next : next;
+        return full ? records + next : records;
+    }
+    static const record* get_second_run(u32& count)
+    {
+        count = full ? next : 0;
+        return records;
+    }
+
+private:
+    static record records[capacity];
+    static u32 next; // the record to write
+    static u32 lost; // overwritten since the restart
+    static u64 last_time;
+    static bool full;
+    static bool recording;
+};
+
+}
+}
+
+#endif
@@ -25,6 +25,7 @@
 #include "dev/clock_lpc3230.hpp"
 #include "dev/interrupt_lpc3230.hpp"
 #include "ctl.h"
+#include "modules/profiling/event_trace.hpp"
 
 namespace profile {
 
@@ -43,18 +44,46 @@ namespace type
     };
 }
 
+#if ENABLE_PROFILE_HISTOGRAMS
+// the run times of a sample, counted in log-scale buckets, two per power of two : bucket 2m holds [2^m, 1.5 * 2^m), and 2m + 1 holds
+// [1.5 * 2^m, 2^(m + 1)). a bucket is found with a count leading zeros, the percentiles are read within the width of a bucket
+struct histogram
+{
+    static const u32 bucket_count = 64;
+    u32 buckets[bucket_count];
+
+    void add(u64 run_time)
+    {
+        u32 t = (run_time >> 32) ? 0xFFFFFFFF : static_cast<u32>(run_time);
+        if (t < 2)
+            ++buckets[t];
+        else
+        {
+            u32 msb = 31 - __builtin_clz(t);
+            ++buckets[2 * msb + ((t >> (msb - 1)) & 1)];
+        }
+    }
+
+    u64 percentile(u32 count, u32 per_thousand, u64 worst) const; // in system units, at most the worst
+};
+#endif
+
 struct sample
 {
     const char* name;
     u64 begin_time; // in system unit : time at which the begin() was called
     u64 run_accumulator; // accumulates the run (cpu) time used by the sample. this is the life time minus all time spent in interrupts or while switched to another task
     u64 worst_run_time; // longest time ever recorded in run time for a sample to complete
+    u64 begin_accumulator; // run_accumulator at the begin(), the run time of each completion being taken from it
     u32 sample_count; // amount of samples accumulated, used to compute the mean time, but also to estimate the frequency at which some code it used
     u32 switch_count; // how many times this sample was suspended by task switching
     u32 interrupt_count; // how many times this sample was interrupted by IRQ or FIQ
     bool allocated;
     bool updated;
     type::en t;
+    #if ENABLE_PROFILE_HISTOGRAMS
+        histogram run_times; // of each completion
+    #endif
 };
 
 class controller
@@ -68,6 +97,9 @@ public:
         next_int_sample_id = 0; 
         memset(interrupt_id_to_sample_id, 0, sizeof(interrupt_id_to_sample_id));
         memset(samples, 0, sizeof(samples));
+        #if ENABLE_PROFILE_TRACE
+            trace::recorder::init();
+        #endif
     }
 
     static void init_task(const char* name, CTL_TASK_t* task)
@@ -110,7 +142,13 @@ public:
         }
 
         ctl_task_executing->sample_id_hierarchy[++ctl_task_executing->sample_id_hierarchy_index] = id;
+        samples[id].begin_accumulator = samples[id].run_accumulator;
         samples[id].begin_time = get_hw_clock().get_system_time();
+        #if ENABLE_PROFILE_TRACE
+            int enabled = ctl_global_interrupts_set(0);
+                trace::recorder::add(trace::record_type::begin, ctl_task_executing->task_id, id, samples[id].begin_time);
+            ctl_global_interrupts_set(enabled);
+        #endif
 
         return sample_id;
     }
@@ -121,13 +159,22 @@ public:
 
         u32 id = ctl_task_executing->sample_id_hierarchy[ctl_task_executing->sample_id_hierarchy_index];
 
-        u64 diff = time - samples[id].begin_time;
-        if (diff > samples[id].worst_run_time)
-            samples[id].worst_run_time = diff;
-        samples[id].run_accumulator += diff;
+        samples[id].run_accumulator += time - samples[id].begin_time;
+        u64 run = samples[id].run_accumulator - samples[id].begin_accumulator; // since the begin(), less the interrupts and the other tasks
+        if (run > samples[id].worst_run_time)
+            samples[id].worst_run_time = run;
+        #if ENABLE_PROFILE_HISTOGRAMS
+            samples[id].run_times.add(run);
+        #endif
         ++samples[id].sample_count;
         samples[id].updated = true;
 
+        #if ENABLE_PROFILE_TRACE
+            int enabled = ctl_global_interrupts_set(0);
+                trace::recorder::add(trace::record_type::end, ctl_task_executing->task_id, id, time);
+            ctl_global_interrupts_set(enabled);
+        #endif
+
         --ctl_task_executing->sample_id_hierarchy_index;
     }
 
@@ -150,6 +197,9 @@ public:
 
         interrupt_id_hierarchy[interrupt_id_hierarchy_index++] = id;
         samples[id].begin_time = get_hw_clock().get_system_time();
+        #if ENABLE_PROFILE_TRACE
+            trace::recorder::add(trace::record_type::interrupt_begin, ctl_task_executing->task_id, id, samples[id].begin_time);
+        #endif
 
         return id;
     }
@@ -164,8 +214,14 @@ public:
         samples[id].run_accumulator += diff;
         if (diff > samples[id].worst_run_time)
             samples[id].worst_run_time = diff;
+        #if ENABLE_PROFILE_HISTOGRAMS
+            samples[id].run_times.add(diff);
+        #endif
         ++samples[id].sample_count;
         samples[id].updated = true;
+        #if ENABLE_PROFILE_TRACE
+            trace::recorder::add(trace::record_type::interrupt_end, ctl_task_executing->task_id, id, time);
+        #endif
 
         for (u32 i = 0; i < samples_per_tasks; ++i)
         {
@@ -185,6 +241,10 @@ public:
         u64 diff;
         u32 task_sample_id, index;
 
+        #if ENABLE_PROFILE_TRACE
+            trace::recorder::add(trace::record_type::task_switch, to->task_id, from->task_id, time);
+        #endif
+
         if (from->state != CTL_STATE_SUSPENDED)
         {
             for (u32 i = 0; i < samples_per_tasks; ++i)
@@ -231,6 +291,9 @@ public:
     }
 
     static void report();
+    #if ENABLE_PROFILE_TRACE
+        static bool dump_trace(const char* filename); // writes the event trace to a file, then restarts it. from a task
+    #endif
 
 private:
     static u32 get_next_sample_id(type::en t, CTL_TASK_t* task)
@@ -252,6 +315,7 @@ private:
         return id;
     }
 
+    static void report_sample(u32 id);
     static u64 report_interrupts(const u64& time);
     static void report_tasks(const u64& time, u64& idle_time, u64& console_time);
 
@@ -3,6 +3,7 @@
 #ifdef CTL_PROFILING
 
 #include "modules/debug/debug_io.hpp"
+#include "modules/file_system/file_system.hpp"
 
 extern "C"
 {
@@ -56,6 +57,15 @@ u64 profile::controller::last_total_task_time = 0;
 u64 profile::controller::last_total_time = 0;
 profile::sample profile::controller::samples[profile::total_samples_allocated];
 
+#if ENABLE_PROFILE_TRACE
+    profile::trace::record profile::trace::recorder::records[profile::trace::recorder::capacity] __attribute__ ((section (".non_init"))); // not cleared at startup. in DDR for the DDR loader, the internal RAM otherwise : see PROFILE_TRACE_RECORDS
+    u32 profile::trace::recorder::next;
+    u32 profile::trace::recorder::lost;
+    u64 profile::trace::recorder::last_time;
+    bool profile::trace::recorder::full;
+    bool profile::trace::recorder::recording;
+#endif
+
 namespace profile {
 
 void controller::report()
@@ -63,8 +73,13 @@ void controller::report()
     u64 time = get_hw_clock().get_system_time();
 
     debug::printf("Profile run\r\n");
-    debug::printf("  Id | Sample name          |       Run Time |  Average R. T. |    Worst R. T. |    Counted |   Switched | Interrupt. \r\n");
-    debug::printf("----------------------------------------------------------------------------------------------------------------------\r\n");
+    #if ENABLE_PROFILE_HISTOGRAMS
+        debug::printf("  Id | Sample name          |       Run Time |  Average R. T. |    Worst R. T. |    Counted |   Switched | Interrupt. |       p50 R. T. |       p90 R. T. |       p99 R. T. |     p99.9 R. T. \r\n");
+        debug::printf("------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\r\n");
+    #else
+        debug::printf("  Id | Sample name          |       Run Time |  Average R. T. |    Worst R. T. |    Counted |   Switched | Interrupt. \r\n");
+        debug::printf("----------------------------------------------------------------------------------------------------------------------\r\n");
+    #endif
 
     debug::printf(" *** Interrupts\r\n");
     u64 total_int_time = report_interrupts(time);
@@ -93,6 +108,32 @@ void controller::report()
     debug::printf(" CPU Usage since last prof %3.3f%%\r\n", usage);
 }
 
+void controller::report_sample(u32 id)
+{
+    float run_time = get_hw_clock().system_to_sec(samples[id].run_accumulator);
+    float worst_run_time = get_hw_clock().system_to_sec(samples[id].worst_run_time);
+    float avg_run_time = run_time / (float)(samples[id].sample_count ? samples[id].sample_count : 1);
+    debug::printf("%4d | %-20s | %14f | %14f | %14f | %10d | %10d | %10d ",
+                  id,
+                  samples[id].name,
+                  run_time,
+                  avg_run_time,
+                  worst_run_time,
+                  samples[id].sample_count,
+                  samples[id].switch_count,
+                  samples[id].interrupt_count);
+    #if ENABLE_PROFILE_HISTOGRAMS
+        static const u32 per_thousands[] = { 500, 900, 990, 999 };
+        for (u32 p = 0; p < sizeof(per_thousands) / sizeof(u32); ++p)
+        {
+            u64 percentile = samples[id].run_times.percentile(samples[id].sample_count, per_thousands[p], samples[id].worst_run_time);
+            debug::printf("| %15f ", get_hw_clock().system_to_sec(percentile));
+        }
+    #endif
+    debug::printf("\r\n");
+    samples[id].updated = false;
+}
+
 u64 controller::report_interrupts(const u64& time)
 {
     u64 total_int_time = 0;
@@ -101,19 +142,7 @@ u64 controller::report_interrupts(const u64& time)
         if (samples[id].allocated && samples[id].updated)
         {
             total_int_time += samples[id].run_accumulator;
-            float run_time = get_hw_clock().system_to_sec(samples[id].run_accumulator);
-            float worst_run_time = get_hw_clock().system_to_sec(samples[id].worst_run_time);
-            float avg_run_time = run_time / (float)(samples[id].sample_count ? samples[id].sample_count : 1);
-            debug::printf("%4d | %-20s | %14f | %14f | %14f | %10d | %10d | %10d \r\n",
-                          id,
-                          samples[id].name,
-                          run_time,
-                          avg_run_time,
-                          worst_run_time,
-                          samples[id].sample_count,
-                          samples[id].switch_count,
-                          samples[id].interrupt_count);
-            samples[id].updated = false;
+            report_sample(id);
         }
     }
     return total_int_time;
@@ -130,22 +159,86 @@ void controller::report_tasks(const u64& time, u64& idle_time, u64& console_time
                 idle_time = run_time_now; // only add up the time from non-idle tasks
             else if (id == console_task_id)
                 console_time = run_time_now; // only add up the time from non-idle tasks
-            float run_time = get_hw_clock().system_to_sec(run_time_now);
-            float worst_run_time = get_hw_clock().system_to_sec(samples[id].worst_run_time);
-            float avg_run_time = run_time / (float)(samples[id].sample_count ? samples[id].sample_count : 1);
-            debug::printf("%4d | %-20s | %14f | %14f | %14f | %10d | %10d | %10d \r\n",
-                          id,
-                          samples[id].name,
-                          run_time,
-                          avg_run_time,
-                          worst_run_time,
-                          samples[id].sample_count,
-                          samples[id].switch_count,
-                          samples[id].interrupt_count);
-            samples[id].updated = false;
+            report_sample(id);
+        }
+    }
+}
+
+#if ENABLE_PROFILE_TRACE
+bool controller::dump_trace(const char* filename)
+{
+    trace::recorder::pause(); // the records are taken with interrupts disabled, none is half written
+
+    trace::file_header header;
+    header.magic = trace::file_magic;
+    header.version = trace::file_version;
+    header.system_freq = static_cast<u32>(get_hw_clock().get_system_freq());
+    header.samples_per_tasks = samples_per_tasks;
+    header.task_count = task_count;
+    header.name_count = 0;
+    for (u32 id = 0; id < total_samples_allocated; ++id)
+        if (samples[id].allocated)
+            ++header.name_count;
+    header.record_count = trace::recorder::get_count();
+    header.lost = trace::recorder::get_lost();
+    header.last_time = trace::recorder::get_last_time();
+
+    fs::FILE file;
+    bool written = fs::fopen(&file, filename, 'w');
+    if (written)
+    {
+        written = sizeof(header) == fs::fwrite(&header, sizeof(header), 1, &file);
+        for (u32 id = 0; written && id < total_samples_allocated; ++id)
+        {
+            if (!samples[id].allocated)
+                continue;
+            trace::name_entry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.sample = static_cast<u16>(id);
+            strncpy(entry.name, samples[id].name, sizeof(entry.name) - 1);
+            written = sizeof(entry) == fs::fwrite(&entry, sizeof(entry), 1, &file);
+        }
+
+        u32 count;
+        const trace::record* run = trace::recorder::get_first_run(count);
+        if (written && count)
+            written = count * sizeof(trace::record) == fs::fwrite(run, sizeof(trace::record), count, &file);
+        run = trace::recorder::get_second_run(count);
+        if (written && count)
+            written = count * sizeof(trace::record) == fs::fwrite(run, sizeof(trace::record), count, &file);
+        fs::fclose(&file);
+    }
+
+    trace::recorder::restart();
+    return written;
+}
+#endif
+
+#if ENABLE_PROFILE_HISTOGRAMS
+// the run time below which per_thousand of the count completed : the bucket holding that rank, interpolated in its width
+u64 histogram::percentile(u32 count, u32 per_thousand, u64 worst) const
+{
+    if (!count)
+        return 0;
+    u32 rank = static_cast<u32>((static_cast<u64>(count) * per_thousand + 999) / 1000); // the rank-th run time, from 1
+    u32 below = 0;
+    for (u32 b = 0; b < bucket_count; ++b)
+    {
+        if (below + buckets[b] < rank)
+        {
+            below += buckets[b];
+            continue;
         }
+        if (b < 2)
+            return b;
+        u32 msb = b / 2;
+        u64 width = static_cast<u64>(1) << (msb - 1); // half a power of two
+        u64 at = (static_cast<u64>(2 + (b & 1)) * width) + width * (rank - below) / buckets[b];
+        return (at < worst) ? at : worst;
     }
+    return worst;
 }
+#endif
 
 }
 
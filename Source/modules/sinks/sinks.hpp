@@ -2,18 +2,22 @@
 
 #include "modules/init/globals.hpp"
 #include "modules/async/messages.hpp"
+#include "boost/static_assert.hpp"
 
-template <typename impl, msg::src::en source_id, u8 method_observer_size = 0>
+// the impl lists the messages it observes, as a compile-time chain of handlers declared after its observer methods :
+//     typedef on<msg::id::a, &impl::a_event,
+//             on<msg::id::b, &impl::b_event> > observers;
+// base_sink lays them out in a table indexed by message id, so dispatching a message is a single lookup. a message observed twice,
+// or subscribed to without being observed, fails to compile.
+template <typename impl, msg::src::en source_id>
 class base_sink
 {
 public:
-    base_sink()
+    base_sink() : payload_offset(0), correlation(0)
     {
-        for (u32 i = 0; i < method_observer_size; ++i)
-        {
-            method_observers[i].message_id = msg::id::none;
-            method_observers[i].method = 0;
-        }
+        for (u32 i = 0; i < msg::id::none; ++i)
+            dispatch_table[i] = 0;
+        impl::observers::fill(dispatch_table);
     }
 
     bool observe_message(msg::id::en message_id, u32 len = 0)
@@ -24,8 +28,19 @@ public:
         case msg::id::request_to_end_task:
             return true;
             break;
+        case msg::id::reply: // dispatched as the message replied, its payload follows the reply header
+            {
+                const msg::payload::reply& r = *reinterpret_cast<const msg::payload::reply*>(get_central().current_payload(source_id));
+                assert(len >= sizeof(msg::payload::reply));
+                correlation = r.correlation;
+                payload_offset = sizeof(msg::payload::reply);
+                dispatch(r.message, len - sizeof(msg::payload::reply));
+                payload_offset = 0;
+                correlation = 0;
+            }
+            break;
         default:
-            broadcast_to_method_observers(message_id, len);
+            dispatch(message_id, len);
             break;
         }
 
@@ -56,44 +71,73 @@ public:
 
 protected:
     typedef void (impl::*observer_method)(u32 len);
-    struct method_observer
+    typedef void (*dispatcher)(impl& sink, u32 len);
+
+    struct no_observers
     {
-        msg::id::en message_id;
-        observer_method method;
+        template <u32 message_id>
+        struct observes { static const bool value = false; };
+
+        static void fill(dispatcher* table) {}
     };
-    method_observer method_observers[method_observer_size];
 
-    void set_method_observer(msg::id::en message_id, observer_method method)
+    template <msg::id::en message_id, observer_method method, typename next = no_observers>
+    struct on
     {
-        for (u32 i = 0; i < method_observer_size; ++i)
+        BOOST_STATIC_ASSERT(message_id < msg::id::none);
+        BOOST_STATIC_ASSERT(message_id != msg::id::request_to_end_task); // handled by the sink itself
+        BOOST_STATIC_ASSERT(message_id != msg::id::reply); // unwrapped by the sink, observe the message replied
+        BOOST_STATIC_ASSERT(!next::template observes<message_id>::value); // a message has a single observer method
+
+        template <u32 other_id>
+        struct observes { static const bool value = (other_id == static_cast<u32>(message_id)) || next::template observes<other_id>::value; };
+
+        static void call(impl& sink, u32 len)
         {
-            if (message_id == method_observers[i].message_id || msg::id::none == method_observers[i].message_id || !method_observers[i].method)
-            {
-                method_observers[i].message_id = message_id;
-                method_observers[i].method = method;
-                return;
-            }
+            (sink.*method)(len);
         }
-        assert(false);
-    }
+
+        static void fill(dispatcher* table)
+        {
+            table[message_id] = &call;
+            next::fill(table);
+        }
+    };
 
     void read_current_payload(u8* payload, u32 len)
     {
-        get_central().read_current_payload(source_id, payload, len);
+        memcpy(payload, get_central().current_payload(source_id) + payload_offset, len);
     }
 
-    void subscribe_to_global_message(msg::id::en message_id)
+    // the payload viewed in place in the queue, valid until the observer method returns
+    template <typename payload_t>
+    const payload_t& current_payload(u32 len)
     {
+        BOOST_STATIC_ASSERT(__alignof__(payload_t) <= async::message_queue::alignment);
+        assert(sizeof(payload_t) == len);
+        return *reinterpret_cast<const payload_t*>(get_central().current_payload(source_id) + payload_offset);
+    }
+
+    // the correlation of the request answered by the message observed, see msg::central::request. 0 for a message sent to every listener
+    u32 current_correlation() { return correlation; }
+
+    template <msg::id::en message_id>
+    void subscribe_to_global_message()
+    {
+        BOOST_STATIC_ASSERT(impl::observers::template observes<message_id>::value); // a global message nobody here would handle
         get_central().subscribe_to_global_message(source_id, message_id);
     }
 
 private:
-    void broadcast_to_method_observers(msg::id::en message_id, u16 len = 0)
+    void dispatch(msg::id::en message_id, u32 len)
     {
-        for (u32 i = 0; i < method_observer_size; ++i)
-        {
-            if (method_observers[i].message_id == message_id && method_observers[i].method)
-                (static_cast<impl*>(this)->*method_observers[i].method)(len); // sorry for the undecipherable line of C++ : cast (this) to the type of the impl, and call (->*) the method pointer (method_observers[i].method) on it
-        }
+        assert(message_id < msg::id::none);
+        dispatcher d = dispatch_table[message_id];
+        if (d)
+            d(*static_cast<impl*>(this), len);
     }
-};
\ No newline at end of file
+
+    dispatcher dispatch_table[msg::id::none];
+    u32 payload_offset; // of the payload observed, past the reply header for a reply
+    u32 correlation;
+};
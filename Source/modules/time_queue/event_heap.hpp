@@ -0,0 +1,125 @@
+#pragma once
+
+#include "armtastic/types.hpp"
+#include "assert.h"
+#include "boost/static_assert.hpp"
+
+namespace time_queue
+{
+    // the times of the slots scheduled, earliest first : a binary min-heap, with the position of each slot in it so a slot can be moved or
+    // removed without searching. push, remove and update are O(log n), the earliest one is read in O(1). times are millisecond clock values,
+    // compared across the wrap of the clock : two times must be less than 2^31 ms apart.
+    template <u32 capacity>
+    class event_heap
+    {
+    public:
+        BOOST_STATIC_ASSERT(capacity < 0xffff);
+
+        void init()
+        {
+            count = 0;
+            for (u32 i = 0; i < capacity; ++i)
+                position[i] = absent;
+        }
+
+        u32 size() { return count; }
+        bool empty() { return 0 == count; }
+        bool contains(u32 slot) { return absent != position[slot]; }
+
+        u32 top_slot() { assert(count); return entries[0].slot; }
+        u32 top_time() { assert(count); return entries[0].time_ms; }
+
+        void push(u32 slot, u32 time_ms)
+        {
+            assert(slot < capacity && !contains(slot));
+            entries[count].slot = static_cast<u16>(slot);
+            entries[count].time_ms = time_ms;
+            position[slot] = static_cast<u16>(count);
+            sift_up(count++);
+        }
+
+        void remove(u32 slot)
+        {
+            assert(contains(slot));
+            u32 at = position[slot];
+            position[slot] = absent;
+            if (at == --count)
+                return;
+            entries[at] = entries[count];
+            position[entries[at].slot] = static_cast<u16>(at);
+            place(at);
+        }
+
+        // the slot keeps its place in the heap, moved to its new time
+        void update(u32 slot, u32 time_ms)
+        {
+            assert(contains(slot));
+            u32 at = position[slot];
+            entries[at].time_ms = time_ms;
+            place(at);
+        }
+
+        static bool before(u32 a, u32 b) { return static_cast<s32>(a - b) < 0; }
+
+    private:
+        static const u16 absent = 0xffff;
+
+        struct entry
+        {
+            u32 time_ms;
+            u16 slot;
+        };
+
+        void place(u32 at)
+        {
+            if (at && before(entries[at].time_ms, entries[(at - 1) / 2].time_ms))
+                sift_up(at);
+            else
+                sift_down(at);
+        }
+
+        void sift_up(u32 at)
+        {
+            entry moving = entries[at];
+            while (at)
+            {
+                u32 parent = (at - 1) / 2;
+                if (!before(moving.time_ms, entries[parent].time_ms))
+                    break;
+                move(parent, at);
+                at = parent;
+            }
+            entries[at] = moving;
+            position[moving.slot] = static_cast<u16>(at);
+        }
+
+        void sift_down(u32 at)
+        {
+            entry moving = entries[at];
+            while (true)
+            {
+                u32 child = 2 * at + 1;
+                if (child >= count)
+                    break;
+                if (child + 1 < count && before(entries[child + 1].time_ms, entries[child].time_ms))
+                    ++child;
+                if (!before(entries[child].time_ms, moving.time_ms))
+                    break;
+                move(child, at);
+                at = child;
+            }
+            entries[at] = moving;
+            position[moving.slot] = static_cast<u16>(at);
+        }
+
+        void move(u32 from, u32 to)
+        {
+            entries[to] = entries[from];
+            position[entries[to].slot] = static_cast<u16>(to);
+        }
+
+        entry entries[capacity];
+        u16 position[capacity]; // in entries, of each slot
+        u32 count;
+    };
+}
@@ -4,25 +4,29 @@
 #include "modules/init/globals.hpp"
 #include "modules/sinks/sinks.hpp"
 #include "modules/async/messages.hpp"
+#include "modules/time_queue/event_heap.hpp"
+#include "modules/clock/rt_clock.hpp"
 
 namespace time_queue
 {
-    static const u32 queue_size = 32;
-
-    class queue : public base_sink<queue, msg::src::time_queue, 3>
+    static const u32 queue_size = msg::max_time_events;
+    static const u32 timepulse_timeout_ms = 2000; // an older timepulse is lost, the aligned events keep their phase on the local clock meanwhile
+
+    // sends the events scheduled through msg::central::schedule, or enqueued with msg::id::enqueue_time_event, when their time comes. each event
+    // sits in the slot of its handle, the slots due first are kept in an event_heap.
+    // an event may be sent up to its slack after its time : the task wakes up at the earliest time + slack of all the events, and sends every
+    // event whose time has come by then. events due within each other's slack thus go out together, for a single wake up.
+    class queue : public base_sink<queue, msg::src::time_queue>
     {
     public:
         void init()
         {
-            timeout = 0;
-            current_event_queue_size = 0;
+            scheduled.init();
+            deadlines.init();
+            wakeups = sent = 0;
 
             ctl_events_init(&events, 0);
             get_central().set_event(msg::src::time_queue, &events, messages_mask);
-
-            set_method_observer(msg::id::timeout, &queue::timeout_event);
-            set_method_observer(msg::id::enqueue_time_event, &queue::enqueue_time_event);
-            set_method_observer(msg::id::kill_time_event, &queue::kill_time_event);
         }
 
         static void static_thread(void* argument)
@@ -30,6 +34,9 @@ namespace time_queue
             get_time_queue().thread();
         }
 
+        u32 get_wakeups() { return wakeups; } // to send events
+        u32 get_sent() { return sent; }
+
     private:
         void thread()
         {
@@ -38,8 +45,8 @@ namespace time_queue
             bool done = false;
             while (!done)
             {
-                if (current_event_queue_size > 0)
-                    event_received = ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &events, messages_mask, CTL_TIMEOUT_DELAY, timeout);
+                if (!scheduled.empty())
+                    event_received = ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &events, messages_mask, CTL_TIMEOUT_DELAY, next_timeout());
                 else
                     event_received = ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &events, messages_mask, CTL_TIMEOUT_INFINITE, 0);
 
@@ -47,128 +54,114 @@ namespace time_queue
             }
         }
 
+        // sends every event due
         void timeout_event(u32 len)
         {
-            assert(current_event_queue_size);
-            assert(msg::payload::time_event_types::invalid != event_queue[0].type);
-
-            get_central().send_message(event_queue[0].dest, event_queue[0].message);
-
-            if (msg::payload::time_event_types::once == event_queue[0].type)
-                event_queue[0].type = msg::payload::time_event_types::invalid;
-            else if (msg::payload::time_event_types::repeating == event_queue[0].type)
-                event_queue[0].next_time_ms = get_hw_clock().get_millisec_time() + event_queue[0].period;
-
-            reinsert();
-        }
+            ++wakeups;
+            u32 now = get_hw_clock().get_millisec_time();
+            while (!scheduled.empty() && !event_heap<queue_size>::before(now, scheduled.top_time()))
+            {
+                u32 slot = scheduled.top_slot();
+                msg::payload::enqueue_time_event& ev = event_table[slot];
 
-        void enqueue_time_event(u32 len)
-        {
-            msg::payload::enqueue_time_event payload;
-            assert(sizeof(payload) == len);
-            read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
-            insert(payload);
-        }
+                if (ev.correlation)
+                    get_central().expire_request(ev.correlation);
+                else
+                    get_central().send_message(ev.dest, ev.message);
+                ++sent;
 
-        void kill_time_event(u32 len)
-        {
-            msg::payload::enqueue_time_event payload;
-            assert(sizeof(payload) == len);
-            read_current_payload(reinterpret_cast<u8*>(&payload), sizeof(payload));
-            
-            u32 it = 0;
-            while (it < current_event_queue_size)
-            {
-                if (msg::payload::time_event_types::repeating == event_queue[it].type &&
-                    payload.message == event_queue[it].message &&
-                    payload.dest == event_queue[it].dest)
+                if (msg::payload::time_event_types::once != ev.type)
                 {
-                    for (u32 push = it; push < current_event_queue_size - 1; ++push)
-                        event_queue[it] = event_queue[it + 1];
-                    --current_event_queue_size;
-                    break;
+                    ev.next_time_ms = next_time(ev, now);
+                    scheduled.update(slot, ev.next_time_ms);
+                    deadlines.update(slot, ev.next_time_ms + ev.slack);
                 }
-                ++it;
+                else
+                    end(slot);
             }
         }
 
-        void insert(const msg::payload::enqueue_time_event& ev)
+        void enqueue_time_event(u32 len)
         {
-            if (msg::payload::time_event_types::invalid == ev.type)
-                return;
+            const msg::payload::enqueue_time_event& payload = current_payload<msg::payload::enqueue_time_event>(len);
+            async::handle_pool<queue_size>& handles = get_central().get_time_events();
 
-            u32 it = 0;
-            if (msg::payload::time_event_types::invalid != event_queue[0].type)
+            u32 handle = payload.handle ? payload.handle : handles.allocate();
+            assert(handle); // no more slots!
+            if (!handle)
+                return;
+            assert(handles.valid(handle));
+            if (msg::payload::time_event_types::invalid == payload.type)
             {
-                while (it < queue_size - 1)
-                {
-                    if (msg::payload::time_event_types::invalid == event_queue[it].type)
-                        break;
-                    else if (ev.next_time_ms < event_queue[it].next_time_ms)
-                        break;
-                    ++it;
-                }
-            }
-
-            assert(it != queue_size - 1); // no more slots!
-            if (it == queue_size - 1)
+                handles.release(handle);
                 return;
+            }
 
-            for (u32 push = current_event_queue_size; push > it; --push)
-                event_queue[push] = event_queue[push - 1];
-
-            event_queue[it] = ev;
-            ++current_event_queue_size;
-
-            if (0 == it)
-                update_timeout();
+            u32 slot = handles.slot(handle);
+            msg::payload::enqueue_time_event& ev = event_table[slot];
+            ev = payload;
+            ev.handle = handle;
+            assert(msg::payload::time_event_types::once == ev.type || (ev.period && ev.phase < ev.period));
+            if (msg::payload::time_event_types::timepulse_aligned == ev.type) // on the timepulse from the start
+                ev.next_time_ms = next_time(ev, get_hw_clock().get_millisec_time());
+            scheduled.push(slot, ev.next_time_ms);
+            deadlines.push(slot, ev.next_time_ms + ev.slack);
         }
 
-        void reinsert()
+        // the first time after now of a repeating event : a whole number of periods after its current time, so the time taken to handle the
+        // event does not accumulate, or after the latest timepulse for an aligned one. the times already passed are skipped, not caught up
+        u32 next_time(const msg::payload::enqueue_time_event& ev, u32 now)
         {
-            u32 it = 1;
-            if (msg::payload::time_event_types::invalid == event_queue[0].type)
-            {
-                for (u32 push = 0; push < current_event_queue_size - 1; ++push)
-                    event_queue[push] = event_queue[push + 1];
-                --current_event_queue_size;
-            }
-            else
-            {
-                while (it < queue_size - 1)
-                {
-                    if (msg::payload::time_event_types::invalid == event_queue[it].type)
-                        break;
-                    else if (event_queue[0].next_time_ms < event_queue[it].next_time_ms)
-                        break;
-                    ++it;
-                }
+            u32 base = ev.next_time_ms;
+            u32 pulse;
+            if (msg::payload::time_event_types::timepulse_aligned == ev.type && timepulse(pulse))
+                base = pulse + ev.phase;
+            s32 late = static_cast<s32>(now - base);
+            if (late < 0)
+                return base;
+            return base + (late / ev.period + 1) * ev.period;
+        }
 
-                msg::payload::enqueue_time_event tmp = event_queue[0];
-                for (u32 push = 0; push < it - 1; ++push)
-                    event_queue[push] = event_queue[push + 1];
-                event_queue[it - 1] = tmp;
-            }
+        bool timepulse(u32& pulse_ms)
+        {
+            return get_rt_clock().get_timepulse_millisec(pulse_ms) &&
+                   static_cast<s32>(get_hw_clock().get_millisec_time() - pulse_ms) < static_cast<s32>(timepulse_timeout_ms);
+        }
 
-            update_timeout();
+        void kill_time_event(u32 len)
+        {
+            const msg::payload::kill_time_event& payload = current_payload<msg::payload::kill_time_event>(len);
+            async::handle_pool<queue_size>& handles = get_central().get_time_events();
+            if (handles.valid(payload.handle) && scheduled.contains(handles.slot(payload.handle)))
+                end(handles.slot(payload.handle));
         }
 
-        void update_timeout()
+        void end(u32 slot)
         {
-            u32 next_time = event_queue[0].next_time_ms;
-            u32 current_time = get_hw_clock().get_millisec_time();
+            scheduled.remove(slot);
+            deadlines.remove(slot);
+            get_central().get_time_events().release(event_table[slot].handle);
+        }
 
-            if (next_time < current_time)
-                timeout = 0;
-            else
-                timeout = (next_time - current_time) * ctl_get_ticks_per_second() / 1000;
+        CTL_TIME_t next_timeout()
+        {
+            s32 remaining = static_cast<s32>(deadlines.top_time() - get_hw_clock().get_millisec_time());
+            return (remaining > 0) ? remaining * ctl_get_ticks_per_second() / 1000 : 0;
         }
 
+    public:
+        typedef on<msg::id::timeout, &queue::timeout_event,
+                on<msg::id::enqueue_time_event, &queue::enqueue_time_event,
+                on<msg::id::kill_time_event, &queue::kill_time_event> > > observers;
+
+    private:
         static const CTL_EVENT_SET_t messages_mask = 1 << 0;
         CTL_EVENT_SET_t events;
 
-        u32 timeout;
-        msg::payload::enqueue_time_event event_queue[queue_size];
-        u32 current_event_queue_size;
+        event_heap<queue_size> scheduled; // by time
+        event_heap<queue_size> deadlines; // by time + slack
+        u32 wakeups; // on a timeout
+        u32 sent;
+        msg::payload::enqueue_time_event event_table[queue_size]; // by slot
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "modules/init/globals.hpp"
+
+#if ENABLE_MESSAGE_BENCHMARKS
+
+#include "modules/async/message_queue.hpp"
+#include "modules/profiling/profiler.hpp"
+#include <ctl_api.h>
+
+namespace benchmarks {
+
+// contention between tasks posting to the same queue, mutex against lock-free. a low priority task sends continuously, a high priority task
+// wakes up every tick to send a burst, preempting the first one, possibly in the middle of a send. a consumer in between drains the queue.
+// the profiler reports the cost of a send in each sender, mean and worst : the worst case of the high priority sender is the one the mutex hurts.
+class messages
+{
+public:
+    void run()
+    {
+        contention<false>(mutex_queue);
+        contention<true>(lock_free_queue);
+    }
+
+    static void static_thread(void* argument)
+    {
+        get_message_bench().run();
+    }
+
+private:
+    static const u32 low_priority_sends = 20000;
+    static const u32 high_priority_burst = 4;
+    static const u32 task_queue_size = 256;
+    static const u32 int_queue_size = 64;
+    static const u32 sender_id_shift = 24; // the payload carries the sender in its high byte, a sequence number in the rest
+
+    template <bool lock_free>
+    struct context
+    {
+        async::basic_message_queue<lock_free>* queue;
+        CTL_EVENT_SET_t events;
+        volatile bool low_done;
+        volatile bool high_done;
+        u32 received;
+        u32 out_of_order;
+        u32 next_sequence[2];
+    };
+
+    template <bool lock_free>
+    void contention(async::basic_message_queue<lock_free>& queue)
+    {
+        static context<lock_free> c;
+        c.queue = &queue;
+        c.low_done = c.high_done = false;
+        c.received = c.out_of_order = 0;
+        c.next_sequence[0] = c.next_sequence[1] = 0;
+
+        queue.init(queue_buffer, task_queue_size, int_queue_size);
+        ctl_events_init(&c.events, 0);
+        queue.set_event(&c.events, 1);
+
+        // the consumer preempts the low priority sender as soon as a message is published, so the queue never overflows
+        ctl_task_run(&consumer_task, thread_priorities::main + 2, consumer<lock_free>, &c, "bench_consumer", sizeof(consumer_stack) / sizeof(u32), (unsigned int*)consumer_stack, 0);
+        ctl_task_run(&high_task, thread_priorities::main + 3, high_sender<lock_free>, &c, "bench_high", sizeof(high_stack) / sizeof(u32), (unsigned int*)high_stack, 0);
+        ctl_task_run(&low_task, thread_priorities::main + 1, low_sender<lock_free>, &c, "bench_low", sizeof(low_stack) / sizeof(u32), (unsigned int*)low_stack, 0);
+
+        join(low_task);
+        join(high_task);
+        join(consumer_task);
+
+        assert(0 == c.out_of_order);
+    }
+
+    template <bool lock_free>
+    static void send(context<lock_free>& c, u32 sender, u32 sequence)
+    {
+        u32 payload = (sender << sender_id_shift) | sequence;
+        profile_begin(lock_free ? "send_lock_free" : "send_mutex");
+            c.queue->send_message(0, sizeof(payload), reinterpret_cast<u8*>(&payload));
+        profile_end();
+    }
+
+    template <bool lock_free>
+    static void low_sender(void* argument)
+    {
+        context<lock_free>& c = *static_cast<context<lock_free>*>(argument);
+        for (u32 i = 0; i < low_priority_sends; ++i)
+            send(c, 0, i);
+        c.low_done = true;
+    }
+
+    template <bool lock_free>
+    static void high_sender(void* argument)
+    {
+        context<lock_free>& c = *static_cast<context<lock_free>*>(argument);
+        u32 sequence = 0;
+        while (!c.low_done)
+        {
+            ctl_timeout_wait(ctl_get_current_time() + 1);
+            for (u32 i = 0; i < high_priority_burst; ++i)
+                send(c, 1, sequence++);
+        }
+        c.high_done = true;
+        ctl_events_set_clear(&c.events, 1, 0); // so the consumer notices
+    }
+
+    template <bool lock_free>
+    static void consumer(void* argument)
+    {
+        context<lock_free>& c = *static_cast<context<lock_free>*>(argument);
+        while (true)
+        {
+            bool done = c.low_done && c.high_done; // read before draining : whatever was sent before is seen by the drain
+            ctl_events_wait(CTL_EVENT_WAIT_ANY_EVENTS_WITH_AUTO_CLEAR, &c.events, 1, CTL_TIMEOUT_DELAY, 10);
+
+            u32 id, len, payload;
+            while (c.queue->get_message(id, len))
+            {
+                c.queue->read_current_payload(reinterpret_cast<u8*>(&payload), len);
+                c.queue->message_done(len);
+
+                u32 sender = payload >> sender_id_shift;
+                if ((payload & ((1 << sender_id_shift) - 1)) != c.next_sequence[sender])
+                    ++c.out_of_order;
+                c.next_sequence[sender] = (payload & ((1 << sender_id_shift) - 1)) + 1;
+                ++c.received;
+            }
+
+            if (done)
+                break;
+        }
+    }
+
+    static void join(CTL_TASK_t& task)
+    {
+        while (CTL_STATE_SUSPENDED != task.state)
+            ctl_timeout_wait(ctl_get_current_time() + 10);
+        ctl_task_remove(&task);
+    }
+
+    async::basic_message_queue<false> mutex_queue;
+    async::basic_message_queue<true> lock_free_queue;
+    u8 queue_buffer[task_queue_size + int_queue_size] __attribute__ ((aligned (8)));
+
+    CTL_TASK_t low_task;
+    CTL_TASK_t high_task;
+    CTL_TASK_t consumer_task;
+    u32 low_stack[256];
+    u32 high_stack[256];
+    u32 consumer_stack[256];
+};
+
+}
+
+#endif
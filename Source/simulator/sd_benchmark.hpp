@@ -5,6 +5,7 @@
 #if ENABLE_SD_BENCHMARKS
 
 #include "modules/file_system/file_system.hpp"
+#include "modules/file_system/file_system_queue.hpp"
 
 namespace benchmarks {
 
@@ -13,15 +14,10 @@ class sd
 public:
     void run()
     {
-        fs::statistics stats;
-
         profile_begin("write_raw");
             fs::FILE raw_file;
-            fs::reset_stats();
             bool opened = fs::fopen(&raw_file, "bench/raw_uart.dat", 'w', true);
             assert(opened);
-            stats = fs::get_stats();
-            fs::reset_stats();
     
             static const u32 len = 8 * SECTOR_SIZE;
             for (u32 b = 0; b < len / SECTOR_SIZE; ++b)
@@ -36,18 +32,14 @@ public:
             fs::fflush(&raw_file);
             u32 size = raw_file.fileinfo.filelen;
             assert(size == len * sizeof(u32));
-            stats = fs::get_stats();
             fs::fclose(&raw_file);
         profile_end();
 
         profile_begin("read_raw");
-            fs::reset_stats();
             opened = fs::fopen(&raw_file, "bench/raw_uart.dat", 'r', true);
             assert(opened);
             size = raw_file.fileinfo.filelen;
             assert(size == len * sizeof(u32));
-            stats = fs::get_stats();
-            fs::reset_stats();
     
             u32 data;
             for (u32 b = 0; b < len / SECTOR_SIZE; ++b)
@@ -60,7 +52,6 @@ public:
                 }
             }
             
-            stats = fs::get_stats();
             fs::fclose(&raw_file);
         profile_end();
 
@@ -93,7 +84,163 @@ public:
     
             fs::fclose(&raw_file);
         profile_end();
+
+        bulk_read();
+
+        #if ENABLE_FS_QUEUE
+            write_depths();
+        #endif
+
+        #if ENABLE_FS_FREE_MAP
+            allocation();
+        #endif
+
+        #if ENABLE_FS_SESSION_INDEX
+            sessions();
+        #endif
+    }
+
+    // reads back a file the size of the GPS benchmark inputs, one sector per call then one large buffer per call.
+    // the large reads are split on contiguous cluster runs, each of them going out as a single multiple block command.
+    void bulk_read()
+    {
+        static const u32 bulk_len = 512 * 1024;
+        static const u32 bulk_words = sizeof(bulk_buffer) / sizeof(u32);
+
+        fs::FILE bulk_file;
+        bool opened = fs::fopen(&bulk_file, "bench/bulk.dat", 'w', true);
+        assert(opened);
+        for (u32 b = 0; b < bulk_len / sizeof(bulk_buffer); ++b)
+        {
+            for (u32 i = 0; i < bulk_words; i++)
+                bulk_buffer[i] = i + b * bulk_words;
+            fs::fwrite(bulk_buffer, sizeof(bulk_buffer), 1, &bulk_file);
+        }
+        fs::fclose(&bulk_file);
+
+        opened = fs::fopen(&bulk_file, "bench/bulk.dat", 'r', true);
+        assert(opened);
+        for (u32 b = 0; b < bulk_len / SECTOR_SIZE; ++b)
+        {
+            profile_begin("read_sector");
+                u32 read = fs::fread(buffer, SECTOR_SIZE, 1, &bulk_file);
+            profile_end();
+            assert(read == SECTOR_SIZE);
+        }
+        fs::fclose(&bulk_file);
+
+        opened = fs::fopen(&bulk_file, "bench/bulk.dat", 'r', true);
+        assert(opened);
+        for (u32 b = 0; b < bulk_len / sizeof(bulk_buffer); ++b)
+        {
+            profile_begin("read_bulk");
+                u32 read = fs::fread(bulk_buffer, sizeof(bulk_buffer), 1, &bulk_file);
+            profile_end();
+            assert(read == sizeof(bulk_buffer));
+            assert(bulk_buffer[0] == b * bulk_words && bulk_buffer[bulk_words - 1] == (b + 1) * bulk_words - 1);
+        }
+        fs::fclose(&bulk_file);
+    }
+
+    #if ENABLE_FS_QUEUE
+    // sustained write throughput through the file system queue, depending on how many blocks it may leave in flight. see the rates in write_rates.
+    void write_depths()
+    {
+        get_fs_queue().set_write_depth(1);
+        profile_begin("write_depth_1");
+            write_rates[0] = queued_write();
+        profile_end();
+
+        get_fs_queue().set_write_depth(2);
+        profile_begin("write_depth_2");
+            write_rates[1] = queued_write();
+        profile_end();
+
+        get_fs_queue().set_write_depth(4);
+        profile_begin("write_depth_4");
+            write_rates[2] = queued_write();
+        profile_end();
+
+        get_fs_queue().set_write_depth(FS_QUEUE_WRITE_DEPTH);
+    }
+
+    float queued_write() // in bytes per second, until the last block has reached the card
+    {
+        static const u32 queued_len = 1024 * 1024;
+
+        fs::FILE queued_file;
+        bool opened = fs::fopen(&queued_file, "bench/queued.dat", 'w', true);
+        assert(opened);
+
+        u64 begin = get_hw_clock().get_system_time();
+        for (u32 b = 0; b < queued_len / sizeof(bulk_buffer); ++b)
+            fs::fwrite(bulk_buffer, sizeof(bulk_buffer), 1, &queued_file);
+        fs::fclose(&queued_file);
+        while (!get_fs_queue().is_idle())
+            ctl_timeout_wait(ctl_get_current_time() + 1);
+        u64 delay = get_hw_clock().get_system_time() - begin;
+        us elapsed = get_hw_clock().system_to_microsec(delay);
+
+        return static_cast<float>(queued_len) / (static_cast<float>(elapsed) / 1000000.f);
+    }
+    #endif
+
+    #if ENABLE_FS_FREE_MAP
+    // compares the cost of finding a free cluster by scanning the FAT against the in-RAM free cluster map.
+    // the scan cost grows with the amount of clusters used ahead of the first free one, so run this on a card that already holds some logs.
+    void allocation()
+    {
+        static const u32 allocation_count = 32;
+        u32 scan_cluster = 0, map_cluster = 0;
+
+        fs::use_free_map(false);
+        for (u32 i = 0; i < allocation_count; ++i)
+        {
+            profile_begin("alloc_fat_scan");
+                scan_cluster = fs::find_free_cluster();
+            profile_end();
+        }
+
+        fs::use_free_map(true);
+        for (u32 i = 0; i < allocation_count; ++i)
+        {
+            profile_begin("alloc_free_map");
+                map_cluster = fs::find_free_cluster();
+            profile_end();
+        }
+
+        assert(scan_cluster == map_cluster); // both start from the beginning of the volume, they must agree
+    }
+    #endif
+
+    #if ENABLE_FS_SESSION_INDEX
+    // what a boot goes through before its first log write : numbering and creating the session directory, then opening a file in it.
+    // by scanning the root against resuming from the session index. each pass adds sessions, so the scan slows down as the root fills up.
+    void sessions()
+    {
+        static const u32 session_count = 32;
+
+        static fs::FILE log_file; // fclose completes in the queue, after this returns
+
+        for (u32 i = 0; i < session_count; ++i)
+        {
+
+            fs::use_session_index(false);
+            profile_begin("session_scan");
+                bool opened = fs::new_session() && fs::fopen(&log_file, "raw_log.dat", 'w');
+            profile_end();
+            assert(opened);
+            fs::fclose(&log_file);
+
+            fs::use_session_index(true);
+            profile_begin("session_index");
+                opened = fs::new_session() && fs::fopen(&log_file, "raw_log.dat", 'w');
+            profile_end();
+            assert(opened);
+            fs::fclose(&log_file);
+        }
     }
+    #endif
 
     static void static_thread(void* argument)
     {
@@ -102,6 +249,10 @@ public:
 
 private:
     u32 buffer[SECTOR_SIZE / sizeof(u32)];
+    u32 bulk_buffer[MAX_SD_READ_CONSECUTIVE_BLOCKS * SECTOR_SIZE / sizeof(u32)];
+    #if ENABLE_FS_QUEUE
+        float write_rates[3]; // at depths 1, 2 and 4
+    #endif
 };
 
 }
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "modules/init/globals.hpp"
+
+#if ENABLE_TIME_QUEUE_BENCHMARKS
+
+#include "modules/time_queue/event_heap.hpp"
+#include "modules/profiling/profiler.hpp"
+
+namespace benchmarks {
+
+// the time_queue's event_heap against the sorted array it replaced, for a growing number of periodic events. each round fires the earliest
+// event and schedules it one period later, then cancels a random event and schedules it anew, the way the periodic jobs and the request
+// timeouts use the time_queue. the profiler reports the cost of each, the array's growing linearly with the number of events.
+class time_events
+{
+public:
+    void run()
+    {
+        compare<16>("tq_array_fire_16", "tq_array_cancel_16", "tq_heap_fire_16", "tq_heap_cancel_16");
+        compare<32>("tq_array_fire_32", "tq_array_cancel_32", "tq_heap_fire_32", "tq_heap_cancel_32");
+        compare<128>("tq_array_fire_128", "tq_array_cancel_128", "tq_heap_fire_128", "tq_heap_cancel_128");
+        compare<max_events>("tq_array_fire_256", "tq_array_cancel_256", "tq_heap_fire_256", "tq_heap_cancel_256");
+    }
+
+    static void static_thread(void* argument)
+    {
+        get_time_queue_bench().run();
+    }
+
+private:
+    static const u32 max_events = 256;
+    static const u32 rounds = 10000;
+
+    // the former time_queue : the events kept sorted by time, shifting the ones after the place of an event inserted or removed, and
+    // searching an event cancelled
+    template <u32 capacity>
+    struct sorted_array
+    {
+        struct entry
+        {
+            u32 time_ms;
+            u32 slot;
+        };
+
+        void init() { count = 0; }
+
+        void push(u32 slot, u32 time_ms)
+        {
+            assert(count < capacity);
+            u32 at = 0;
+            while (at < count && !time_queue::event_heap<capacity>::before(time_ms, entries[at].time_ms))
+                ++at;
+            for (u32 push = count; push > at; --push)
+                entries[push] = entries[push - 1];
+            entries[at].time_ms = time_ms;
+            entries[at].slot = slot;
+            ++count;
+        }
+
+        void remove_at(u32 at)
+        {
+            for (u32 pull = at; pull < count - 1; ++pull)
+                entries[pull] = entries[pull + 1];
+            --count;
+        }
+
+        void remove(u32 slot)
+        {
+            for (u32 at = 0; at < count; ++at)
+            {
+                if (slot == entries[at].slot)
+                {
+                    remove_at(at);
+                    return;
+                }
+            }
+        }
+
+        u32 top_slot() { return entries[0].slot; }
+        u32 top_time() { return entries[0].time_ms; }
+        void update_top(u32 time_ms) { u32 slot = entries[0].slot; remove_at(0); push(slot, time_ms); }
+
+        entry entries[capacity];
+        u32 count;
+    };
+
+    template <u32 event_count>
+    void compare(const char* array_fire, const char* array_cancel, const char* heap_fire, const char* heap_cancel)
+    {
+        BOOST_STATIC_ASSERT(event_count <= max_events);
+        static sorted_array<event_count> array;
+        static time_queue::event_heap<event_count> heap;
+
+        // the times of a slot stay congruent to the slot modulo event_count : no two events are due at once, so both fire the same one
+        seed = 1;
+        for (u32 slot = 0; slot < event_count; ++slot)
+            periods[slot] = (10 + random() % 1000) * event_count;
+        array.init();
+        heap.init();
+        for (u32 slot = 0; slot < event_count; ++slot)
+        {
+            u32 first = (random() % 1000) * event_count + slot;
+            array.push(slot, first);
+            heap.push(slot, first);
+        }
+
+        for (u32 r = 0; r < rounds; ++r)
+        {
+            assert(array.top_time() == heap.top_time());
+            u32 now = heap.top_time() - heap.top_slot();
+
+            profile_begin(array_fire);
+                array.update_top(now + periods[array.top_slot()] + array.top_slot());
+            profile_end();
+            profile_begin(heap_fire);
+                heap.update(heap.top_slot(), now + periods[heap.top_slot()] + heap.top_slot());
+            profile_end();
+
+            u32 cancelled = random() % event_count;
+            profile_begin(array_cancel);
+                array.remove(cancelled);
+                array.push(cancelled, now + periods[cancelled] + cancelled);
+            profile_end();
+            profile_begin(heap_cancel);
+                heap.remove(cancelled);
+                heap.push(cancelled, now + periods[cancelled] + cancelled);
+            profile_end();
+        }
+    }
+
+    u32 random()
+    {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 8;
+    }
+
+    u32 seed;
+    u32 periods[max_events];
+};
+
+}
+
+#endif